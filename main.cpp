@@ -1,7 +1,157 @@
 import std;
+import ai;
+import engine_server;
 import game_modes;
+import game_record;
+import logging;
+import match_runner;
+import nnue;
+import protocol;
+import sprt;
+import trace;
+
+namespace {
+
+int run_match_mode(const std::vector<std::string_view> &args) {
+    const auto options = match::parse_options(args);
+    if (!options) {
+        std::cout << "usage: gomoku --match [--engine name=a,depth=2,time=ms,tt=16,threads=1,nnue=path|off]x2\n"
+                     "                      [--games N] [--concurrency N] [--opening-plies N] [--seed N] [--out file]\n"
+                     "                      [--record file]\n";
+        return 1;
+    }
+    const auto summary = match::run_match(*options, [&](const match::game_result &, const match::match_summary &s) {
+        std::cout << std::format("{} +{} -{} ={} / {}\n", options->first.name, s.first_wins, s.second_wins, s.draws, options->games);
+        return true;
+    });
+    if (!summary) {
+        std::cout << "Cannot write the results, see the log.\n";
+        return 1;
+    }
+    std::cout << std::format("{} vs {}: +{} -{} ={} in {:.1f} s, results in {}\n", options->first.name, options->second.name,
+                             summary->first_wins, summary->second_wins, summary->draws, summary->seconds,
+                             options->output.string());
+    return 0;
+}
+
+int run_sprt_mode(const std::vector<std::string_view> &args) {
+    const auto options = sprt::parse_options(args);
+    if (!options) {
+        std::cout << "usage: gomoku --sprt --engine <new> --engine <base> [--elo0 0] [--elo1 5] [--alpha 0.05] [--beta 0.05]\n"
+                     "                     [--max-games N] [--concurrency N] [--opening-plies N] [--seed N] [--out file]\n";
+        return 1;
+    }
+    const auto report = [&](const sprt::sprt_result &r) {
+        const auto [elo, error] = r.pairs.elo();
+        std::cout << std::format("pairs {} {} elo {:+.1f} +/- {:.1f} llr {:.2f} ({:.2f}, {:.2f})\n",
+                                 r.pairs.pairs(), std::format("{}", r.pairs.counts), elo, error, r.llr, r.lower_bound,
+                                 r.upper_bound);
+    };
+    const auto result = sprt::run(*options, report);
+    if (!result) {
+        std::cout << "Cannot write the results, see the log.\n";
+        return 1;
+    }
+    report(*result);
+    std::cout << std::format("{} vs {}: {}\n", options->match.first.name, options->match.second.name,
+                             sprt::to_string(result->outcome));
+    return 0;
+}
+
+// --export-records <games.gmr> writes the text form to stdout;
+// --import-records <games.txt> <games.gmr> appends text games to a record file.
+int run_record_mode(const std::vector<std::string_view> &args) {
+    const auto export_flag = std::ranges::find(args, "--export-records");
+    if (export_flag != args.end() && std::next(export_flag) != args.end()) {
+        const auto games = record::reader::open(std::filesystem::path{*std::next(export_flag)});
+        if (!games) {
+            return 1;
+        }
+        record::export_text(*games, std::cout);
+        return 0;
+    }
+    const auto import_flag = std::ranges::find(args, "--import-records");
+    if (import_flag != args.end() && std::distance(import_flag, args.end()) >= 3) {
+        const std::filesystem::path text{*std::next(import_flag)};
+        const std::filesystem::path binary{*std::next(import_flag, 2)};
+        std::ifstream in{text};
+        const auto out = record::writer::open(binary);
+        if (!in || !out) {
+            std::cout << "Cannot open " << text.string() << " or " << binary.string() << '\n';
+            return 1;
+        }
+        std::cout << record::import_text(in, *out) << " games imported\n";
+        return 0;
+    }
+    std::cout << "usage: gomoku --export-records <games.gmr>\n"
+                 "       gomoku --import-records <games.txt> <games.gmr>\n";
+    return 1;
+}
+
+int run_server_mode(const std::vector<std::string_view> &args) {
+    const auto options = server::parse_options(args);
+    if (!options) {
+        std::cout << "usage: gomoku --serve [--unix path | --port N] [--threads N] [--max-active N] [--max-queue N]\n"
+                     "                      [--max-sessions N] [--tt-mb N] [--tt-partitioned] [--tt-snapshot file]\n"
+                     "                      [--tt-shm name] [--tt-numa interleave|partition]\n"
+                     "                      [--depth N] [--deadline-ms N]\n";
+        return 1;
+    }
+    server::engine_server engine_server(*options);
+    if (!engine_server.ready()) {
+        std::cout << "Cannot use shared table " << options->tt_shared_memory << ", see the log.\n";
+        return 1;
+    }
+    return engine_server.run() ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    const std::vector<std::string_view> args(argv + 1, argv + argc);
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--nnue" && i + 1 < args.size()) {
+            auto network = nnue::network::load(std::filesystem::path{args[++i]});
+            if (!network) {
+                std::cout << "Failed to load network weights, using pattern evaluation.\n";
+            }
+            ai::set_default_network(std::move(network));
+        } else if (args[i] == "--trace" && i + 1 < args.size()) {
+            if (!trace::start(std::filesystem::path{args[++i]})) {
+                std::cout << "Tracing is not compiled in; rebuild with GOMOKU_TRACE=1.\n";
+            }
+        } else if (args[i] == "--record" && i + 1 < args.size()) {
+            game_modes::set_record_path(std::filesystem::path{args[++i]});
+        }
+    }
+
+    if (std::ranges::find(args, "--protocol") != args.end()) {
+        protocol::run();
+        logging::shutdown();
+        return 0;
+    }
+    if (std::ranges::find(args, "--export-records") != args.end() ||
+        std::ranges::find(args, "--import-records") != args.end()) {
+        const int status = run_record_mode(args);
+        logging::shutdown();
+        return status;
+    }
+    if (std::ranges::find(args, "--serve") != args.end()) {
+        const int status = run_server_mode(args);
+        logging::shutdown();
+        return status;
+    }
+    if (std::ranges::find(args, "--sprt") != args.end()) {
+        const int status = run_sprt_mode(args);
+        logging::shutdown();
+        return status;
+    }
+    if (std::ranges::find(args, "--match") != args.end()) {
+        const int status = run_match_mode(args);
+        logging::shutdown();
+        return status;
+    }
 
-int main() {
     std::cout << " ---------------------------------------\n";
     std::cout << "|             Wuziqi Game               |\n";
     std::cout << "|                                       |\n";
@@ -38,5 +188,6 @@ int main() {
         }
     }
 
+    logging::shutdown();
     return 0;
 }
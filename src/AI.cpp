@@ -1,26 +1,39 @@
 module;
-#include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/spdlog.h>
 #include <stdexec/execution.hpp>
 #include <exec/static_thread_pool.hpp>
-#include <shared_mutex>
 #include <optional>
-#include <random>
 
 export module ai;
 
 import std;
 
 import chess_info;
+import logging;
+import memory;
+import nnue;
 import pattern;
 import point;
+import proof_search;
 import rule;
+import search_stack;
 import strings;
+import tool;
+import trace;
+import transposition_table;
 
-namespace {
-
+// Not exported, but outside an anonymous namespace: the engine template is
+// instantiated in importing units and refers to these.
+namespace ai {
 
 constexpr int search_infinity = 0x0f3f3f3f;
+constexpr int win_threshold = 40000;
+constexpr int win_score = 50000;
+// Half-width of the window around a score predicted by the previous search.
+constexpr int aspiration_window = 300;
+// Moves after the TT move: first those whose static gain says they make or
+// stop a four, by gain, then killers, then the rest by gain and history.
+constexpr int forcing_gain = 5000;
 
 constexpr std::array<pattern_entry, 18> score_table_black{ {
     { "11111", 50000 },
@@ -68,420 +81,1029 @@ constexpr std::array<point, 4> evaluation_directions{
     point{-1, 0}, point{0, -1}, point{-1, -1}, point{-1, 1}
 };
 
-[[nodiscard]] std::shared_ptr<spdlog::logger> ai_logger() {
-    static std::shared_ptr<spdlog::logger> logger = [] {
-        if (auto existing = spdlog::get("ai_logger")) {
-            return existing;
-        }
-        try {
-            auto created = spdlog::basic_logger_mt("ai_logger", "ai.log", true);
-            created->set_level(spdlog::level::info);
-            created->flush_on(spdlog::level::info);
-            return created;
-        } catch (const spdlog::spdlog_ex &ex) {
-            spdlog::default_logger()->error("Failed to create ai logger: {}", ex.what());
-            return spdlog::default_logger();
-        }
-    }();
+inline constexpr auto black_patterns = compile_patterns(score_table_black);
+inline constexpr auto white_patterns = compile_patterns(score_table_white);
+// Lines shorter than every pattern never score and are left out.
+inline constexpr int shortest_pattern = std::ranges::min(black_patterns, {}, &compiled_pattern::length).length;
+
+// A full line of the board: `length` cells from `start` in steps of `step`.
+struct board_line {
+    point start;
+    point step;
+    int length{0};
+};
+
+// Every line along the evaluation directions, each walked from its end
+// against the direction, long enough for a pattern.
+template <int Size>
+consteval auto make_lines() {
+    std::array<board_line, 6 * Size - 18> lines{};
+    std::size_t count = 0;
+    for (const point direction : evaluation_directions) {
+        const point step{-direction.x, -direction.y};
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                if (point{x - step.x, y - step.y}.is_on_board<Size>()) continue;
+                int length = 0;
+                for (point p{x, y}; p.is_on_board<Size>(); p += step) ++length;
+                if (length < shortest_pattern) continue;
+                if (count == lines.size()) throw "line count";
+                lines[count++] = board_line{point{x, y}, step, length};
+            }
+        }
+    }
+    if (count != lines.size()) throw "line count";
+    return lines;
+}
+
+template <int Size>
+inline constexpr auto board_lines = make_lines<Size>();
+
+[[nodiscard]] const std::shared_ptr<spdlog::logger> &ai_logger() {
+    static const std::shared_ptr<spdlog::logger> logger = logging::async_file_logger("ai_logger", "ai.log");
     return logger;
 }
 
-uint64_t zobrist_table[16][16][2];
-bool zobrist_initialized = false;
+template <int Size>
+struct zobrist_keys {
+    uint64_t table[Size + 1][Size + 1][2]{};
+    uint64_t freestyle = 0;  // keeps renju and freestyle entries apart in a shared TT
+};
 
-void init_zobrist() {
-    if (zobrist_initialized) return;
-    std::mt19937_64 rng(12345);
-    for (int i : std::views::iota(1, 16)) {
-        for (int j : std::views::iota(1, 16)) {
-            zobrist_table[i][j][0] = rng();
-            zobrist_table[i][j][1] = rng();
+template <int Size>
+consteval zobrist_keys<Size> make_zobrist() {
+    zobrist_keys<Size> keys;
+    std::uint64_t state = 12345;
+    for (int i = 1; i <= Size; ++i) {
+        for (int j = 1; j <= Size; ++j) {
+            keys.table[i][j][0] = tool::splitmix64(state);
+            keys.table[i][j][1] = tool::splitmix64(state);
         }
     }
-    zobrist_initialized = true;
+    keys.freestyle = tool::splitmix64(state);
+    return keys;
 }
 
-int evaluate_line(char* line, size_t len, const std::array<pattern_entry, 18>& table) {
+template <int Size>
+inline constexpr zobrist_keys<Size> zobrist = make_zobrist<Size>();
+
+// Adds the score of every pattern found in `line`. Cells of a match are
+// marked used (3), so later patterns in the table cannot count them again.
+template <std::size_t N>
+int evaluate_line(std::uint8_t *line, int len, const std::array<compiled_pattern, N> &table) {
     int score = 0;
-    for (const auto& entry : table) {
-        char* it = line;
-        char* end = line + len;
-        while ((it = std::search(it, end, entry.s.begin(), entry.s.end())) != end) {
-            score += entry.score;
-            std::fill(it, it + entry.s.length(), '3');
+    for (const auto &[cells, length, value] : table) {
+        for (int i = 0; i + length <= len; ++i) {
+            if (std::equal(cells.begin(), cells.begin() + length, line + i)) {
+                score += value;
+                std::fill_n(line + i, length, std::uint8_t{3});
+            }
         }
     }
     return score;
 }
 
-char to_char(int i) {
-    return static_cast<char>(i + '0');
+// Cells on either side of a move that its gain along one line looks at.
+constexpr int gain_reach = 4;
+// Windows of gain_reach cells on one side of a move that a board can have:
+// every cell empty, black or white, and the cells off the board, if any,
+// farthest out. 3^4 + 3^3 + 3^2 + 3 + 1.
+constexpr int half_windows = 121;
+
+// The half windows in gain-map bits, two per cell (0 empty, 1 black,
+// 2 white, 3 off the board); `far_low` puts the farthest cell lowest.
+consteval std::array<std::uint8_t, half_windows> make_half_windows(bool far_low) {
+    std::array<std::uint8_t, half_windows> codes{};
+    int count = 0;
+    for (int code = 0; code < 1 << 2 * gain_reach; ++code) {
+        bool reachable = true;
+        bool on_board = false;
+        for (int i = 0; i < gain_reach; ++i) {
+            const bool off = (code >> 2 * (far_low ? i : gain_reach - 1 - i) & 3) == 3;
+            reachable = reachable && !(off && on_board);
+            on_board = on_board || !off;
+        }
+        if (!reachable) continue;
+        if (count == half_windows) throw "half window count";
+        codes[count++] = static_cast<std::uint8_t>(code);
+    }
+    if (count != half_windows) throw "half window count";
+    return codes;
+}
+
+// A gain-map key holds the cells before the move in its low byte, farthest
+// lowest, and those after it in its high byte, farthest highest.
+inline constexpr auto before_windows = make_half_windows(true);
+inline constexpr auto after_windows = make_half_windows(false);
+
+consteval std::array<std::uint8_t, 256> make_half_index(const std::array<std::uint8_t, half_windows> &codes) {
+    std::array<std::uint8_t, 256> index{};
+    for (int i = 0; i < half_windows; ++i) index[codes[i]] = static_cast<std::uint8_t>(i);
+    return index;
+}
+
+inline constexpr auto before_index = make_half_index(before_windows);
+inline constexpr auto after_index = make_half_index(after_windows);
+
+// The same half windows with black and white swapped, as indices.
+consteval std::array<std::uint8_t, half_windows> make_swapped(const std::array<std::uint8_t, half_windows> &codes,
+                                                             const std::array<std::uint8_t, 256> &index) {
+    std::array<std::uint8_t, half_windows> swapped{};
+    for (int i = 0; i < half_windows; ++i) {
+        int code = 0;
+        for (int k = 0; k < gain_reach; ++k) {
+            const int cell = codes[i] >> 2 * k & 3;
+            code |= (cell == black_piece ? white_piece : cell == white_piece ? black_piece : cell) << 2 * k;
+        }
+        swapped[i] = index[code];
+    }
+    return swapped;
 }
 
-}  // namespace
+constexpr int window_length = 2 * gain_reach + 1;
 
-export namespace ai {
+// One placement of a pattern in a window of window_length cells packed two
+// bits per cell, the first cell lowest.
+struct window_match {
+    std::uint32_t mask;
+    std::uint32_t cells;
+    int score;
+};
 
-class engine {
-public:
-    engine(int depth = 3) : max_depth(depth) {}
+template <std::size_t N>
+consteval std::size_t window_match_count(const std::array<compiled_pattern, N> &table) {
+    std::size_t count = 0;
+    for (const auto &pattern : table) count += window_length - pattern.length + 1;
+    return count;
+}
 
-    [[nodiscard]] point get_best_point(chess_info state) {
-        if (state.round == 0) return {8, 8};
+// Every placement of every pattern, in the order evaluate_line tries them.
+template <std::size_t Count, std::size_t N>
+consteval std::array<window_match, Count> make_window_matches(const std::array<compiled_pattern, N> &table) {
+    std::array<window_match, Count> matches{};
+    std::size_t count = 0;
+    for (const auto &[pattern_cells, pattern_length, value] : table) {
+        std::uint32_t cells = 0;
+        for (int k = 0; k < pattern_length; ++k) cells |= std::uint32_t{pattern_cells[k]} << 2 * k;
+        const std::uint32_t mask = (std::uint32_t{1} << 2 * pattern_length) - 1;
+        for (int i = 0; i + pattern_length <= window_length; ++i) matches[count++] = {mask << 2 * i, cells << 2 * i, value};
+    }
+    return matches;
+}
 
-        init_zobrist();
-        uint64_t current_hash = 0;
-        for (int i : std::views::iota(1, 16)) {
-            for (int j : std::views::iota(1, 16)) {
-                if (state.pieces[i][j] == 1) current_hash ^= zobrist_table[i][j][0];
-                else if (state.pieces[i][j] == 2) current_hash ^= zobrist_table[i][j][1];
+inline constexpr auto black_window_matches =
+    make_window_matches<window_match_count(black_patterns)>(black_patterns);
+
+// evaluate_line on a packed window: a match is marked by setting its cells
+// to 3, which no pattern has.
+constexpr int window_score(std::uint32_t cells, const auto &matches) {
+    int score = 0;
+    for (std::size_t i = 0; i < matches.size(); ++i) {
+        if ((cells & matches[i].mask) == matches[i].cells) {
+            score += matches[i].score;
+            cells |= matches[i].mask;
+        }
+    }
+    return score;
+}
+
+// White's patterns are black's with the colours swapped, in the same order,
+// so a window scores for white what its swapped window scores for black.
+consteval bool colours_swapped(const auto &black, const auto &white) {
+    for (std::size_t i = 0; i < black.size(); ++i) {
+        if (black[i].length != white[i].length || black[i].score != white[i].score) return false;
+        for (int k = 0; k < black[i].length; ++k) {
+            const int cell = black[i].cells[k];
+            if (white[i].cells[k] != (cell == black_piece ? white_piece : cell == white_piece ? black_piece : cell)) return false;
+        }
+    }
+    return black.size() == white.size();
+}
+
+static_assert(colours_swapped(black_patterns, white_patterns));
+
+// Gain of a stone along one line, for black and for white: what its own
+// patterns gain plus what the opponent's lose, as evaluate_line scores the
+// window of gain_reach cells on either side. One entry per pair of half
+// windows; see gain_index. A constant table, so no process pays for it at
+// start-up; evaluating it takes more steps than compilers allow by
+// default, and the build raises their limits.
+consteval auto make_line_gains() {
+    std::vector<int> black_scores(half_windows * 3 * half_windows);
+    const auto at = [](int before, int center, int after) { return (before * 3 + center) * half_windows + after; };
+    for (int before = 0; before < half_windows; ++before) {
+        for (int center = 0; center < 3; ++center) {
+            for (int after = 0; after < half_windows; ++after) {
+                const std::uint32_t window = before_windows[before] | static_cast<std::uint32_t>(center) << 2 * gain_reach |
+                                             std::uint32_t{after_windows[after]} << 2 * (gain_reach + 1);
+                black_scores[at(before, center, after)] = window_score(window, black_window_matches);
             }
         }
+    }
+    const auto swapped_before = make_swapped(before_windows, before_index);
+    const auto swapped_after = make_swapped(after_windows, after_index);
+    std::array<std::array<int, 2>, half_windows * half_windows> table{};
+    for (int before = 0; before < half_windows; ++before) {
+        for (int after = 0; after < half_windows; ++after) {
+            const auto black = [&](int center) { return black_scores[at(before, center, after)]; };
+            const auto white = [&](int center) {
+                const int swapped = center == black_piece ? white_piece : center == white_piece ? black_piece : center;
+                return black_scores[at(swapped_before[before], swapped, swapped_after[after])];
+            };
+            table[before * half_windows + after] = {black(black_piece) - black(0) + white(0) - white(black_piece),
+                                                    white(white_piece) - white(0) + black(0) - black(white_piece)};
+        }
+    }
+    return table;
+}
 
-        bool maximizing = (state.turn == 0); 
-        point best_move{-1, -1};
-        int best_val = maximizing ? -search_infinity : search_infinity;
-        
-        auto moves = get_moves(state);
-        if (moves.empty()) return {8, 8};
-
-        std::vector<point> winning_candidates;
-
-        // check for immediate win (five or live four)
-        for (const auto& move : moves) {
-            chess_info next_state = state;
-            int piece = (state.turn == 0) ? 1 : 2;
-            next_state.pieces[move.x][move.y] = piece;
-
-            if (state.turn == 0) {
-                if (!rule::is_win(next_state.pieces, move)) {
-                    if (rule::is_double_three(next_state.pieces, move) ||
-                        rule::is_double_four(next_state.pieces, move) ||
-                        rule::is_long_chain(next_state.pieces, move, 1)) {
-                        continue;
+inline constexpr auto line_gains = make_line_gains();
+
+// Entry of line_gains for a gain-map key, which a board always makes of
+// two half windows it can have.
+[[nodiscard]] constexpr std::size_t gain_index(std::uint16_t key) noexcept {
+    return std::size_t{before_index[key & 0xFF]} * half_windows + after_index[key >> 8];
+}
+
+// Static gain of a stone on every cell, per colour, kept up to date as
+// stones are placed and removed. Each cell keeps its line_gains key along
+// the four axes; a stone only changes the keys of the cells within
+// gain_reach on its own four lines.
+template <int Size>
+class basic_gain_map {
+public:
+    explicit basic_gain_map(const rule::board_cells<Size> &board) {
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                for (int axis = 0; axis < axes; ++axis) {
+                    auto &key = keys_[x][y][axis];
+                    for (int k = -gain_reach; k <= gain_reach; ++k) {
+                        const point p{x + k * deltas[axis].x, y + k * deltas[axis].y};
+                        if (k != 0) key |= static_cast<std::uint16_t>((p.is_on_board<Size>() ? board[p.x][p.y] : 3) << shift(k));
                     }
                 }
             }
+        }
+    }
 
-            if (rule::is_win(next_state.pieces, move)) {
-                return move; // win
-            }
+    // Call with the colour of the stone placed on, or removed from, `origin`.
+    void place(point origin, int color) noexcept { toggle(origin, color); }
+    void remove(point origin, int color) noexcept { toggle(origin, color); }
 
-            int score = evaluate(next_state);
-            if (state.turn == 0) { 
-                if (score >= 40000) winning_candidates.push_back(move);
-            } else { 
-                if (score <= -40000) winning_candidates.push_back(move);
+    // Gain of a `color` stone on the empty cell `p`.
+    [[nodiscard]] int gain(point p, int color) const noexcept {
+        int total = 0;
+        for (const auto key : keys_[p.x][p.y]) total += line_gains[gain_index(key)][color - 1];
+        return total;
+    }
+
+private:
+    static constexpr int axes = 4;
+    static constexpr std::array<point, axes> deltas{point{1, 0}, point{0, 1}, point{1, 1}, point{1, -1}};
+
+    // Bit offset of the cell k steps along the axis from the key's cell.
+    [[nodiscard]] static constexpr int shift(int k) noexcept { return 2 * (k < 0 ? gain_reach + k : gain_reach + k - 1); }
+
+    void toggle(point origin, int color) noexcept {
+        for (int axis = 0; axis < axes; ++axis) {
+            for (int k = -gain_reach; k <= gain_reach; ++k) {
+                // `origin` is -k steps from p.
+                const point p{origin.x + k * deltas[axis].x, origin.y + k * deltas[axis].y};
+                if (k != 0 && p.is_on_board<Size>()) keys_[p.x][p.y][axis] ^= static_cast<std::uint16_t>(color << shift(-k));
             }
         }
+    }
 
-        // immediate loss block
-        for (const auto& move : moves) {
-            chess_info next_state = state;
-            int piece = (state.turn == 0) ? 2 : 1; 
-            next_state.pieces[move.x][move.y] = piece;
-            
-            if (state.turn == 1) { 
-                 if (!rule::is_win(next_state.pieces, move)) {
-                    if (rule::is_double_three(next_state.pieces, move) ||
-                        rule::is_double_four(next_state.pieces, move) ||
-                        rule::is_long_chain(next_state.pieces, move, 1)) {
-                        continue; 
-                    }
-                }
+    std::array<std::array<std::array<std::uint16_t, axes>, Size + 1>, Size + 1> keys_{};
+};
+
+std::shared_ptr<const nnue::network> &default_network_slot() {
+    static std::shared_ptr<const nnue::network> network;
+    return network;
+}
+
+}  // namespace ai
+
+export namespace ai {
+
+struct engine_options {
+    int depth = 3;
+    rule::variant rules = rule::variant::renju;
+    std::size_t tt_megabytes = 64;
+    memory::placement tt_placement = memory::placement::interleave;  // pages of an own TT on a NUMA host
+    unsigned threads = 0;  // 0: one per hardware thread
+    bool use_network = true;  // false forces the pattern evaluator
+    std::shared_ptr<const nnue::network> network;  // empty: the default network, if any
+    std::chrono::milliseconds move_time{0};  // 0: search to `depth` without a deadline
+    std::uint64_t node_limit = 0;            // 0: no node budget
+    std::uint64_t solver_nodes = 20000;      // proof-number budget per move, 0: no solver
+    std::size_t solver_megabytes = 8;        // allocated on the first solve
+    std::size_t eval_cache_megabytes = 4;    // 0: no evaluation cache
+
+    // Resources shared by many engines in one process. When unset the engine
+    // creates its own pool of `threads` workers, search stacks and TT. A
+    // shared stack arena needs one stack per worker of the shared pool.
+    exec::static_thread_pool *pool = nullptr;
+    std::shared_ptr<search::stack_arena> stacks;
+    std::shared_ptr<tt::table> table;
+};
+
+struct search_info {
+    point best_move{-1, -1};
+    int score = 0;   // from the point of view of the side to move
+    int depth = -1;  // last completed iteration
+    std::uint64_t nodes = 0;
+    std::uint64_t eval_hits = 0;    // static evaluations answered by the cache
+    std::uint64_t eval_misses = 0;  // and computed
+    double seconds = 0.0;
+    std::vector<point> pv;  // best move first, then the TT's replies
+    bool reused = false;    // seeded from the previous search's PV
+};
+
+// One ranked root move of a multi-PV analysis.
+struct pv_line {
+    point move;
+    int score = 0;  // from the point of view of the side to move
+    std::vector<point> pv;
+};
+
+// Network picked up by engines constructed afterwards; set once at startup.
+void set_default_network(std::shared_ptr<const nnue::network> network) {
+    default_network_slot() = std::move(network);
+}
+
+[[nodiscard]] const std::shared_ptr<const nnue::network> &default_network() {
+    return default_network_slot();
+}
+
+// What a stored TT score depends on besides the position: the hash keys
+// and the evaluator, i.e. the pattern tables or the network's weights.
+// The keys differ per board size, so do the signatures.
+template <int Size = board_rows>
+[[nodiscard]] tt::snapshot_signature snapshot_signature(const nnue::network *network) {
+    const auto &keys = zobrist<Size>;
+    tt::snapshot_signature signature;
+    signature.keys = tool::fnv1a(std::as_bytes(std::span(&keys.table[0][0][0], (Size + 1) * (Size + 1) * 2)));
+    signature.keys = tool::fnv1a(std::as_bytes(std::span(&keys.freestyle, 1)), signature.keys);
+    if (network) {
+        signature.evaluator = network->fingerprint();
+        return signature;
+    }
+    signature.evaluator = tool::fnv1a({});
+    for (const auto *table : {&score_table_black, &score_table_white}) {
+        for (const auto &[pattern, score] : *table) {
+            signature.evaluator = tool::fnv1a(std::as_bytes(std::span(pattern)), signature.evaluator);
+            signature.evaluator = tool::fnv1a(std::as_bytes(std::span(&score, 1)), signature.evaluator);
+        }
+    }
+    return signature;
+}
+
+// Searches positions on a Size x Size board. The network is trained on
+// 15x15 and is only used there; other sizes use the pattern evaluator.
+template <int Size>
+    requires board_size<Size>
+class basic_engine {
+public:
+    using state_type = basic_chess_info<Size>;
+
+    basic_engine(int depth = 3, rule::variant rules = rule::variant::renju)
+        : basic_engine(engine_options{.depth = depth, .rules = rules}) {}
+
+    explicit basic_engine(const engine_options &options)
+        : max_depth(std::clamp(options.depth, 0, search::max_ply - 2)),
+          rules_(options.rules),
+          network_(Size != board_rows || !options.use_network ? nullptr
+                   : options.network                          ? options.network
+                                                              : default_network_slot()),
+          n_threads_(options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency())),
+          owned_pool_(options.pool ? nullptr : std::make_unique<exec::static_thread_pool>(n_threads_)),
+          pool_(options.pool ? options.pool : owned_pool_.get()),
+          stacks_(options.stacks ? options.stacks : std::make_shared<search::stack_arena>(n_threads_)),
+          move_time_(options.move_time),
+          node_limit_(options.node_limit),
+          solver_nodes_(options.solver_nodes),
+          solver_megabytes_(options.solver_megabytes),
+          eval_cache_(options.eval_cache_megabytes),
+          trans_table(options.table ? options.table : std::make_shared<tt::table>(options.tt_megabytes, options.tt_placement)) {}
+
+    void set_network(std::shared_ptr<const nnue::network> network) {
+        if constexpr (Size == board_rows) {
+            network_ = std::move(network);
+            eval_cache_.clear();
+        }
+    }
+
+    void set_rules(rule::variant rules) noexcept { rules_ = rules; }
+
+    void set_move_time(std::chrono::milliseconds move_time) noexcept { move_time_ = move_time; }
+
+    void set_node_limit(std::uint64_t node_limit) noexcept { node_limit_ = node_limit; }
+
+    // Not for a table shared with other engines that may be searching.
+    void set_tt_megabytes(std::size_t megabytes) { trans_table->resize(megabytes); }
+
+    [[nodiscard]] const search_info &last_search() const noexcept { return last_search_; }
+
+    // Warm start: saves the TT entries searched to at least `min_depth`, or
+    // loads a snapshot taken with the same signature into the current table.
+    bool save_table(const std::filesystem::path &path, int min_depth = 1) const {
+        return trans_table->save(path, snapshot_signature<Size>(network_.get()), min_depth);
+    }
+
+    std::optional<std::uint64_t> load_table(const std::filesystem::path &path) {
+        return trans_table->load(path, snapshot_signature<Size>(network_.get()));
+    }
+
+    [[nodiscard]] point get_best_point(state_type state) {
+        if (move_time_.count() > 0) {
+            return get_best_point(state, std::chrono::steady_clock::now() + move_time_);
+        }
+        return get_best_point(state, std::nullopt);
+    }
+
+    // Searches until `max_depth` is reached or the deadline or node budget
+    // runs out, whichever comes first; at least one iteration always completes.
+    [[nodiscard]] point get_best_point(state_type state, std::optional<std::chrono::steady_clock::time_point> deadline) {
+        search(state, deadline, false);
+        return last_search_.best_move;
+    }
+
+    // Ranks up to `lines` root moves, best first, each with its exact score
+    // at the last completed depth and its PV. Every root move is already
+    // searched with a full window, so one search yields all the lines; only
+    // the forced-move shortcuts are skipped so a forced position still gets
+    // ranked alternatives. last_search() describes the first line. Without
+    // a deadline the move time, if any, sets one as for get_best_point.
+    [[nodiscard]] std::vector<pv_line> analyze(state_type state, int lines,
+                                               std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt) {
+        if (!deadline && move_time_.count() > 0) {
+            deadline = std::chrono::steady_clock::now() + move_time_;
+        }
+        search(state, deadline, true);
+        std::vector<pv_line> result;
+        if (root_moves_.empty()) {
+            result.push_back(pv_line{last_search_.best_move, last_search_.score, last_search_.pv});
+        }
+        for (const auto &[move, score] : root_moves_) {
+            if (std::cmp_greater_equal(result.size(), lines) || score == -search_infinity) {
+                break;
             }
+            result.push_back(pv_line{move, score, principal_variation(state, move, std::max(1, last_search_.depth + 1))});
+        }
+        return result;
+    }
+
+private:
+    void search(const state_type &state, std::optional<std::chrono::steady_clock::time_point> deadline, bool all_lines) {
+        root_moves_.clear();
+        if (state.round == 0) {
+            last_search_ = search_info{.best_move = center, .pv = {center}};
+            continuation_.reset();
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        trace::scope tracing{trace_};
+        deadline_ = deadline;
+        nodes_.store(0, std::memory_order_relaxed);
+        eval_hits_.store(0, std::memory_order_relaxed);
+        eval_misses_.store(0, std::memory_order_relaxed);
+
+        const bool black_to_move = state.turn == black_turn;
+        if (rules_ == rule::variant::freestyle) {
+            last_search_ = black_to_move ? search_root<black_piece, rule::freestyle_rules>(state, all_lines)
+                                         : search_root<white_piece, rule::freestyle_rules>(state, all_lines);
+        } else {
+            last_search_ = black_to_move ? search_root<black_piece, rule::renju_rules>(state, all_lines)
+                                         : search_root<white_piece, rule::renju_rules>(state, all_lines);
+        }
+        last_search_.nodes = nodes_.load(std::memory_order_relaxed);
+        last_search_.eval_hits = eval_hits_.load(std::memory_order_relaxed);
+        last_search_.eval_misses = eval_misses_.load(std::memory_order_relaxed);
+        last_search_.pv = principal_variation(state, last_search_.best_move, std::max(1, last_search_.depth + 1));
+        remember_continuation(state);
+        last_search_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ai_logger()->info("depth {} score {} nodes {} time {:.3f}s move ({}, {}){}", last_search_.depth, last_search_.score,
+                          last_search_.nodes, last_search_.seconds, last_search_.best_move.x, last_search_.best_move.y,
+                          last_search_.reused ? " reused" : "");
+        if (eval_cache_.enabled()) {
+            ai_logger()->debug("eval cache: {} hits, {} misses", last_search_.eval_hits, last_search_.eval_misses);
+        }
+        trace_.dump_move();
+    }
+
+    // If the opponent answers with the PV's second move, the next root is
+    // the PV's third ply, already searched to depth - 2 by this search.
+    void remember_continuation(const state_type &state) {
+        continuation_.reset();
+        const auto &pv = last_search_.pv;
+        if (pv.size() < 3 || last_search_.depth < 2) {
+            return;
+        }
+        const int piece = state.turn == black_turn ? black_piece : white_piece;
+        const int opponent = piece == black_piece ? white_piece : black_piece;
+        const uint64_t hash = hash_of(state) ^ zobrist<Size>.table[pv[0].x][pv[0].y][piece - 1] ^
+                              zobrist<Size>.table[pv[1].x][pv[1].y][opponent - 1];
+        continuation_ = continuation{hash, pv[2], last_search_.score, last_search_.depth - 2};
+    }
+
+    int max_depth;
+    rule::variant rules_;
+    std::shared_ptr<const nnue::network> network_;
+    unsigned n_threads_;
+    std::unique_ptr<exec::static_thread_pool> owned_pool_;
+    exec::static_thread_pool *pool_;
+    std::shared_ptr<search::stack_arena> stacks_;
+    std::chrono::milliseconds move_time_;
+    std::uint64_t node_limit_;
+    std::uint64_t solver_nodes_;
+    std::size_t solver_megabytes_;
+    std::unique_ptr<pns::basic_solver<Size>> solver_;
+    search_info last_search_;
+    search::move_list root_moves_;  // ranked root moves of the last completed iteration, analyze() only
+    trace::recorder trace_;
+
+    struct continuation {
+        uint64_t hash = 0;  // expected next root
+        point move;         // our best move there according to the PV
+        int score = 0;      // side to move, same as at the previous root
+        int depth = 0;      // depth the TT already covers below that root
+    };
+    std::optional<continuation> continuation_;
+
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    std::atomic<bool> budget_armed_{false};
+    std::atomic<bool> aborted_{false};
+    std::atomic<std::uint64_t> nodes_{0};
+    std::atomic<std::uint64_t> eval_hits_{0};
+    std::atomic<std::uint64_t> eval_misses_{0};
+
+    // Kept per task and added to the totals above when the task ends.
+    struct eval_counts {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+
+        void publish(std::atomic<std::uint64_t> &total_hits, std::atomic<std::uint64_t> &total_misses) const noexcept {
+            total_hits.fetch_add(hits, std::memory_order_relaxed);
+            total_misses.fetch_add(misses, std::memory_order_relaxed);
+        }
+    };
 
-            if (rule::is_win(next_state.pieces, move)) {
-                return move; // block it
+    // Per-task search state. The board is updated in place by make/unmake,
+    // and the hash, run lengths, move gains, forbidden points and network
+    // accumulator follow it. Forbidden points are only tracked under renju;
+    // unmake restores them from the copy make saved for that ply. Move lists
+    // live in the leased search stack, one frame per ply.
+    struct search_context {
+        state_type board;
+        uint64_t hash = 0;
+        const nnue::network *network = nullptr;
+        search::stack *stack = nullptr;
+        int ply = 0;
+        std::uint64_t nodes = 0;
+        eval_counts evals;
+        nnue::accumulator accumulator{};
+        rule::basic_run_lengths<Size> runs{board.pieces};
+        basic_gain_map<Size> gains{board.pieces};
+        rule::basic_forbidden_map<Size> forbidden{};
+        bool track_forbidden = false;
+        std::array<rule::basic_forbidden_map<Size>, search::max_ply + 1> saved_forbidden{};
+
+        void make(point move, int piece) {
+            ++ply;
+            board.pieces[move.x][move.y] = piece;
+            board.current_point = move;
+            runs.place(board.pieces, move, piece);
+            gains.place(move, piece);
+            if (track_forbidden) {
+                saved_forbidden[ply] = forbidden;
+                forbidden.update(board.pieces, runs, move);
             }
+            hash ^= zobrist<Size>.table[move.x][move.y][piece - 1];
+            if (network) network->add_stone(accumulator, move, piece);
         }
 
-        // prioritize winning candidates
-        if (!winning_candidates.empty()) {
-            moves = winning_candidates;
+        void unmake(point move, int piece, point previous) {
+            --ply;
+            board.pieces[move.x][move.y] = 0;
+            board.current_point = previous;
+            runs.remove(board.pieces, move, piece);
+            gains.remove(move, piece);
+            if (track_forbidden) forbidden = saved_forbidden[ply + 1];
+            hash ^= zobrist<Size>.table[move.x][move.y][piece - 1];
+            if (network) network->remove_stone(accumulator, move, piece);
+        }
+    };
+
+    static constexpr point center{(Size + 1) / 2, (Size + 1) / 2};
+
+    template <int Piece>
+    static constexpr int opponent_of = Piece == black_piece ? white_piece : black_piece;
+
+    // Converts black-positive evaluations to the side to move.
+    template <int Piece>
+    static constexpr int side_sign = Piece == black_piece ? 1 : -1;
+
+    template <int Piece, typename Rules>
+    search_info search_root(const state_type &state, bool all_lines) {
+        constexpr int opponent = opponent_of<Piece>;
+        logging::search_scope searching;
+        trace::span search_span{"search", "engine"};
+
+        const uint64_t current_hash = hash_of(state);
+
+        search::move_list moves;
+        get_moves(state, moves);
+        if (moves.empty()) return search_info{.best_move = center};
+
+        rule::basic_forbidden_map<Size> forbidden;
+        if constexpr (Rules::template has_forbidden<black_piece>) {
+            forbidden.reset(state.pieces, rule::basic_run_lengths<Size>{state.pieces});
         }
 
-        std::vector<int> scores(moves.size());
-        unsigned int n_threads = std::thread::hardware_concurrency();
-        if (n_threads == 0) n_threads = 1;
-        exec::static_thread_pool pool(n_threads);
-        auto scheduler = pool.get_scheduler();
+        search::move_list winning_candidates;
+        if (!all_lines) {
+            trace::span threats_span{"immediate_threats", "rule"};
 
-        auto bulk_sender = stdexec::just()
-            | stdexec::continues_on(scheduler)
-            | stdexec::bulk(moves.size(), [&](size_t i) {
-                const auto& move = moves[i];
-                chess_info next_state = state;
-                int piece = (state.turn == 0) ? 1 : 2;
+            state_type next_state = state;
+            rule::basic_run_lengths<Size> runs{next_state.pieces};
+            const auto try_move = [&](point move, int piece) {
                 next_state.pieces[move.x][move.y] = piece;
+                runs.place(next_state.pieces, move, piece);
+            };
+            const auto undo_move = [&](point move, int piece) {
+                next_state.pieces[move.x][move.y] = 0;
+                runs.remove(next_state.pieces, move, piece);
+            };
+
+            // check for immediate win (five or live four). Scores come
+            // from the pattern evaluator, so the cache only serves them
+            // when that is also the evaluator the search uses.
+            eval_counts evals;
+            const auto scan_evaluate = [&](point move) {
+                if (network_) return evaluate(next_state);
+                const uint64_t key = current_hash ^ zobrist<Size>.table[move.x][move.y][Piece - 1];
+                return cached_evaluate(key, evals, [&] { return evaluate(next_state); });
+            };
+            for (const auto& [move, order] : moves) {
+                if (Rules::template is_forbidden<Piece>(forbidden, move)) {
+                    continue;
+                }
+                try_move(move, Piece);
+                const bool wins = Rules::template wins<Piece>(runs, move);
+                const int score = wins ? 0 : side_sign<Piece> * scan_evaluate(move);
+                undo_move(move, Piece);
 
-                if (state.turn == 0) {
-                    if (!rule::is_win(next_state.pieces, move)) {
-                        if (rule::is_double_three(next_state.pieces, move) ||
-                            rule::is_double_four(next_state.pieces, move) ||
-                            rule::is_long_chain(next_state.pieces, move, 1)) {
-                            scores[i] = maximizing ? -search_infinity : search_infinity;
-                            return;
-                        }
-                    }
+                if (wins) {
+                    return search_info{.best_move = move, .score = 50000, .depth = 0}; // win
                 }
+                if (score >= 40000) winning_candidates.push_back(move);
+            }
+            evals.publish(eval_hits_, eval_misses_);
 
-                next_state.turn = 1 - state.turn;
-                next_state.round++;
-                next_state.current_point = move;
+            // immediate loss block
+            for (const auto& [move, order] : moves) {
+                if (Rules::template is_forbidden<opponent>(forbidden, move)) {
+                    continue;
+                }
+                try_move(move, opponent);
+                const bool wins = Rules::template wins<opponent>(runs, move);
+                undo_move(move, opponent);
 
-                uint64_t next_hash = current_hash ^ zobrist_table[move.x][move.y][piece == 1 ? 0 : 1];
-                scores[i] = minimax(next_state, max_depth, -search_infinity, search_infinity, !maximizing, next_hash);
-            });
+                if (wins) {
+                    return search_info{.best_move = move, .depth = 0}; // block it
+                }
+            }
+        }
 
-        stdexec::sync_wait(std::move(bulk_sender));
+        // A forced win by fours is far cheaper to prove than to search. A
+        // proven result goes into the TT as an exact score at any depth.
+        // The solver shares the move's deadline and node budget.
+        if (!all_lines && solver_nodes_ != 0) {
+            trace::span solver_span{"proof_search", "engine"};
+            if (!solver_) solver_ = std::make_unique<pns::basic_solver<Size>>(solver_megabytes_);
+            const auto budget = node_limit_ != 0 ? std::min(solver_nodes_, node_limit_) : solver_nodes_;
+            const auto proof = solver_->template solve<Rules>(state, budget, deadline_);
+            nodes_.fetch_add(proof.nodes, std::memory_order_relaxed);
+            if (proof.outcome != pns::verdict::unknown) {
+                const bool won = proof.outcome == pns::verdict::win;
+                trans_table->insert(current_hash, tt::entry{won ? win_score : -win_score, tt::exact, search::max_ply, proof.move});
+                ai_logger()->info("solver: {} in {} nodes", won ? "win" : "loss", proof.nodes);
+                if (won) return search_info{.best_move = proof.move, .score = win_score, .depth = 0};
+            }
+        }
 
-        for (auto [val, move] : std::views::zip(scores, moves)) {
-            if (maximizing) {
-                if (val > best_val) {
-                    best_val = val;
-                    best_move = move;
+        // prioritize winning candidates
+        if (!winning_candidates.empty()) {
+            moves = winning_candidates;
+        }
+
+        // A position the previous search predicted: its PV move goes first,
+        // iterations the TT already covers are skipped, and the first one is
+        // searched in a window around the predicted score.
+        int first_depth = 0;
+        std::optional<continuation> reuse;
+        if (continuation_ && continuation_->hash == current_hash) {
+            reuse = continuation_;
+            const auto expected = std::ranges::find_if(moves, [&](const search::scored_move &m) {
+                return m.move.x == reuse->move.x && m.move.y == reuse->move.y;
+            });
+            if (expected != moves.end()) {
+                std::rotate(moves.begin(), expected, expected + 1);
+            }
+            first_depth = std::min(reuse->depth, max_depth);
+        }
+
+        // Iterative deepening. Each iteration searches the root moves in the
+        // order the previous one left them; an iteration cut short by the
+        // deadline is discarded. The limits apply from the second iteration
+        // on, or from the first when that starts deep on a reused PV: its TT
+        // entries may be gone, and if it is cut short the PV move stands.
+        search_info info{.best_move = moves[0].move, .reused = reuse.has_value()};
+        aborted_.store(false, std::memory_order_relaxed);
+        budget_armed_.store(reuse.has_value() && (deadline_.has_value() || node_limit_ != 0), std::memory_order_relaxed);
+        for (int depth = first_depth; depth <= max_depth; ++depth) {
+            trace::span iteration_span{"iteration", "engine"};
+            if (reuse && depth == first_depth && !all_lines) {
+                // Fail-soft root: outside the window the best score is only a
+                // bound, so the iteration is repeated with a full window.
+                const int alpha = reuse->score - aspiration_window;
+                const int beta = reuse->score + aspiration_window;
+                search_iteration<Piece, Rules>(state, current_hash, forbidden, moves, depth, alpha, beta);
+                const int best = std::ranges::max(moves | std::views::transform(&search::scored_move::score));
+                if (!aborted_.load(std::memory_order_relaxed) && (best <= alpha || best >= beta)) {
+                    search_iteration<Piece, Rules>(state, current_hash, forbidden, moves, depth);
                 }
-                if (val >= 40000) break; 
             } else {
-                if (val < best_val) {
-                    best_val = val;
-                    best_move = move;
-                }
-                if (val <= -40000) break;
+                search_iteration<Piece, Rules>(state, current_hash, forbidden, moves, depth);
             }
+            if (aborted_.load(std::memory_order_relaxed)) {
+                break;
+            }
+            moves.stable_sort_by_score();
+            info.best_move = moves[0].move;
+            info.score = moves[0].score;
+            info.depth = depth;
+            budget_armed_.store(deadline_.has_value() || node_limit_ != 0, std::memory_order_relaxed);
+            if (all_lines) root_moves_ = moves;
+            if (info.score >= 40000) break;
         }
-        return best_move;
+        return info;
     }
 
-private:
-    int max_depth;
+    // Scores every root move at `depth` in parallel, one task per move.
+    template <int Piece, typename Rules>
+    void search_iteration(const state_type &state, uint64_t current_hash, const rule::basic_forbidden_map<Size> &forbidden,
+                          search::move_list &moves, int depth,
+                          int alpha = -search_infinity, int beta = search_infinity) {
+        constexpr int opponent = opponent_of<Piece>;
+        auto scheduler = pool_->get_scheduler();
 
-    struct TTEntry {
-        int value;
-        int flag;
-        int depth;
-        point best_move;
-    };
+        auto bulk_sender = stdexec::just()
+            | stdexec::continues_on(scheduler)
+            | stdexec::bulk(static_cast<std::size_t>(moves.size()), [&](size_t i) {
+                auto &[move, score] = moves[static_cast<int>(i)];
+                trace::scope tracing{trace_};
+                trace::span task_span{"root_move", "engine", move};
+                memory::pin_thread_to_node();
+                auto lease = stacks_->acquire();
+                if (Rules::template is_forbidden<Piece>(forbidden, move)) {
+                    score = -search_infinity;
+                    return;
+                }
 
-    std::array<std::array<int, 16>, 16> history_table{};
+                search_context context{state, current_hash, network_.get(), &lease.get()};
+                context.forbidden = forbidden;
+                context.track_forbidden = Rules::template has_forbidden<black_piece>;
+                if constexpr (Size == board_rows) {
+                    if (context.network) context.network->refresh(context.accumulator, state.pieces);
+                }
+                context.make(move, Piece);
 
-    template<typename Key, typename Value>
-    class ShardedMap {
-        static constexpr size_t num_shards = 64;
-        struct Shard {
-            std::shared_mutex mutex;
-            std::unordered_map<Key, Value> map;
-        };
-        std::array<Shard, num_shards> shards;
-        
-        Shard& get_shard(const Key& key) {
-            return shards[key % num_shards];
-        }
+                score = -negamax<opponent, Rules>(context, depth, -beta, -alpha);
+                context.evals.publish(eval_hits_, eval_misses_);
+                // Tasks are often shorter than a batch, so the limits are
+                // checked again as each one ends.
+                check_limits(nodes_.fetch_add(context.nodes & 1023, std::memory_order_relaxed) + (context.nodes & 1023));
+            });
 
-    public:
-        std::optional<Value> find(const Key& key) {
-            auto& shard = get_shard(key);
-            std::shared_lock lock(shard.mutex);
-            auto it = shard.map.find(key);
-            if (it != shard.map.end()) return it->second;
-            return std::nullopt;
+        stdexec::sync_wait(std::move(bulk_sender));
+    }
+
+    // Nodes are published to `nodes_` in batches of 1024 so the node budget
+    // sees every task's progress; the remainder is added when a task ends.
+    [[nodiscard]] bool out_of_budget(search_context &context) {
+        if ((++context.nodes & 1023) == 0) {
+            check_limits(nodes_.fetch_add(1024, std::memory_order_relaxed) + 1024);
         }
-        
-        void insert(const Key& key, const Value& value) {
-            auto& shard = get_shard(key);
-            std::unique_lock lock(shard.mutex);
-            shard.map[key] = value;
+        return aborted_.load(std::memory_order_relaxed);
+    }
+
+    // Aborts the search once armed and past the deadline or node budget;
+    // `total` is the node count published so far.
+    void check_limits(std::uint64_t total) {
+        if (budget_armed_.load(std::memory_order_relaxed) &&
+            ((deadline_ && std::chrono::steady_clock::now() >= *deadline_) || (node_limit_ != 0 && total >= node_limit_))) {
+            aborted_.store(true, std::memory_order_relaxed);
         }
-        
-        void clear() {
-            for (auto& shard : shards) {
-                std::unique_lock lock(shard.mutex);
-                shard.map.clear();
+    }
+
+    [[nodiscard]] uint64_t hash_of(const state_type &state) const {
+        const auto &keys = zobrist<Size>;
+        uint64_t hash = rules_ == rule::variant::freestyle ? keys.freestyle : 0;
+        for (int i : std::views::iota(1, Size + 1)) {
+            for (int j : std::views::iota(1, Size + 1)) {
+                if (state.pieces[i][j] == 1) hash ^= keys.table[i][j][0];
+                else if (state.pieces[i][j] == 2) hash ^= keys.table[i][j][1];
             }
         }
-    };
+        return hash;
+    }
 
-    ShardedMap<uint64_t, TTEntry> trans_table;
+    // Follows the TT's best moves from the root for at most `length` moves;
+    // stops early at a missing entry, an illegal move or a five.
+    [[nodiscard]] std::vector<point> principal_variation(state_type state, point first, int length) const {
+        std::vector<point> pv;
+        uint64_t hash = hash_of(state);
+        int piece = state.turn == black_turn ? black_piece : white_piece;
+        point move = first;
+        while (move.is_on_board<Size>() && state.pieces[move.x][move.y] == 0 && std::cmp_less(pv.size(), length)) {
+            pv.push_back(move);
+            state.pieces[move.x][move.y] = piece;
+            hash ^= zobrist<Size>.table[move.x][move.y][piece - 1];
+            if (rule::is_win(state.pieces, move)) break;
+            piece = piece == black_piece ? white_piece : black_piece;
+            const auto entry = trans_table->find(hash);
+            if (!entry) break;
+            move = entry->best_move;
+        }
+        return pv;
+    }
+
+    std::array<std::array<int, Size + 1>, Size + 1> history_table{};
+
+    tt::eval_cache eval_cache_;
+    std::shared_ptr<tt::table> trans_table;
+
+    // Values are stored from the point of view of the side to move at the node.
+    template <int Piece, typename Rules>
+    int negamax(search_context& context, int depth, int alpha, int beta) {
+        constexpr int opponent = opponent_of<Piece>;
+
+        if (out_of_budget(context)) return 0;
 
-    int minimax(chess_info& board, int depth, int alpha, int beta, bool maximizing, uint64_t hash) {
         int alpha_orig = alpha;
         int beta_orig = beta;
 
         point hash_move = {-1, -1};
-        if (auto entry = trans_table.find(hash)) {
+        if (auto entry = trans_table->find(context.hash)) {
             if (entry->depth >= depth) {
-                if (entry->flag == 0) return entry->value;
-                if (entry->flag == 1) alpha = std::max(alpha, entry->value);
-                else if (entry->flag == 2) beta = std::min(beta, entry->value);
+                if (entry->flag == tt::exact) return entry->value;
+                if (entry->flag == tt::lower) alpha = std::max(alpha, entry->value);
+                else if (entry->flag == tt::upper) beta = std::min(beta, entry->value);
                 if (alpha >= beta) return entry->value;
             }
             hash_move = entry->best_move;
         }
 
-        int score = evaluate(board);
+        int score = side_sign<Piece> * cached_evaluate(context.hash, context.evals,
+                                                       [&] { return evaluate(context.board, context); });
         
-        if (score >= 40000) return score - (max_depth + 1 - depth); 
-        if (score <= -40000) return score + (max_depth + 1 - depth); 
+        if (score >= 40000) return score - context.ply;
+        if (score <= -40000) return score + context.ply;
 
         if (depth == 0) {
             return score;
         }
 
-        auto moves = get_moves(board);
-        if (moves.empty()) return score;
-
-        // Move Ordering
-        std::sort(moves.begin(), moves.end(), [&](const point& a, const point& b) {
-            int score_a = (a.x == hash_move.x && a.y == hash_move.y) ? 10000000 : history_table[a.x][a.y];
-            int score_b = (b.x == hash_move.x && b.y == hash_move.y) ? 10000000 : history_table[b.x][b.y];
-            return score_a > score_b;
-        });
+        auto& frame = context.stack->frames[context.ply];
+        const bool hash_move_legal = hash_move.is_on_board<Size>() && context.board.pieces[hash_move.x][hash_move.y] == 0 &&
+                                     !Rules::template is_forbidden<Piece>(context.forbidden, hash_move);
+        search::move_picker picker{frame, hash_move_legal ? hash_move : point{-1, -1}};
+        // Forbidden points never enter the lists. The forcing moves are found
+        // from the gain map alone; only a node that gets past them and the
+        // killers generates and scores the full list.
+        const auto excluded = Rules::template has_forbidden<Piece> ? &context.forbidden : nullptr;
+        const auto forcing = [&](search::move_list& moves) {
+            moves.clear();
+            for (int i : std::views::iota(1, Size + 1)) {
+                const std::uint32_t blocked = excluded ? excluded->row(i) : 0;
+                for (int j : std::views::iota(1, Size + 1)) {
+                    if (context.board.pieces[i][j] != 0 || (blocked >> j & 1) != 0) continue;
+                    const int gain = context.gains.gain({i, j}, Piece);
+                    if (gain >= forcing_gain && has_neighbor(context.board, {i, j})) moves.push_back({i, j}, gain);
+                }
+            }
+        };
+        const auto usable = [&](point move) {
+            return move.is_on_board<Size>() && context.board.pieces[move.x][move.y] == 0 &&
+                   !Rules::template is_forbidden<Piece>(context.forbidden, move) && has_neighbor(context.board, move) &&
+                   context.gains.gain(move, Piece) < forcing_gain;
+        };
+        const auto quiet = [&](search::move_list& moves) {
+            get_moves(context.board, moves, excluded);
+            moves.erase_if([&](const search::scored_move& m) { return context.gains.gain(m.move, Piece) >= forcing_gain; });
+            for (auto& [move, order] : moves) {
+                order = context.gains.gain(move, Piece) + history_table[move.x][move.y];
+            }
+        };
 
-        int val = 0;
+        int best_eval = -search_infinity;
         point best_move_this_node = {-1, -1};
+        const point previous = context.board.current_point;
 
-        if (maximizing) {
-            int max_eval = -search_infinity;
-            for (const auto& move : moves) {
-                chess_info next_state = board;
-                next_state.pieces[move.x][move.y] = 1; 
-
-                if (!rule::is_win(next_state.pieces, move)) {
-                    if (rule::is_double_three(next_state.pieces, move) ||
-                        rule::is_double_four(next_state.pieces, move) ||
-                        rule::is_long_chain(next_state.pieces, move, 1)) {
-                        continue;
-                    }
-                }
+        while (const auto next = picker.next(forcing, usable, quiet)) {
+            const point move = *next;
+            context.make(move, Piece);
+            int eval = -negamax<opponent, Rules>(context, depth - 1, -beta, -alpha);
+            context.unmake(move, Piece, previous);
 
-                next_state.turn = 1; 
-                next_state.round++;
-                next_state.current_point = move;
-
-                uint64_t next_hash = hash ^ zobrist_table[move.x][move.y][0];
-                int eval = minimax(next_state, depth - 1, alpha, beta, false, next_hash);
-                
-                if (eval > max_eval) {
-                    max_eval = eval;
-                    best_move_this_node = move;
-                }
-                alpha = std::max(alpha, eval);
-                if (beta <= alpha) {
-                    history_table[move.x][move.y] += depth * depth;
-                    break;
-                }
-                if (max_eval >= 40000) break;
+            if (eval > best_eval) {
+                best_eval = eval;
+                best_move_this_node = move;
             }
-            val = max_eval;
-        } else {
-            int min_eval = search_infinity;
-            for (const auto& move : moves) {
-                chess_info next_state = board;
-                next_state.pieces[move.x][move.y] = 2; 
-                next_state.turn = 0; 
-                next_state.round++;
-                next_state.current_point = move;
-
-                uint64_t next_hash = hash ^ zobrist_table[move.x][move.y][1];
-                int eval = minimax(next_state, depth - 1, alpha, beta, true, next_hash);
-                
-                if (eval < min_eval) {
-                    min_eval = eval;
-                    best_move_this_node = move;
+            alpha = std::max(alpha, eval);
+            if (beta <= alpha) {
+                history_table[move.x][move.y] += depth * depth;
+                if ((move.x != hash_move.x || move.y != hash_move.y) && context.gains.gain(move, Piece) < forcing_gain) {
+                    frame.add_killer(move);
                 }
-                beta = std::min(beta, eval);
-                if (beta <= alpha) {
-                    history_table[move.x][move.y] += depth * depth;
-                    break;
-                }
-                if (min_eval <= -40000) break;
+                break;
             }
-            val = min_eval;
+            if (best_eval >= 40000) break;
         }
+        if (!best_move_this_node.is_on_board<Size>()) return score;
 
-        TTEntry entry;
-        entry.value = val;
+        // A search cut short by the deadline or node budget has no trustworthy value.
+        if (aborted_.load(std::memory_order_relaxed)) return 0;
+
+        tt::entry entry;
+        entry.value = best_eval;
         entry.depth = depth;
         entry.best_move = best_move_this_node;
-        if (val <= alpha_orig) entry.flag = 2; // Upper bound
-        else if (val >= beta_orig) entry.flag = 1; // Lower bound
-        else entry.flag = 0; // Exact
-        trans_table.insert(hash, entry);
+        if (best_eval <= alpha_orig) entry.flag = tt::upper;
+        else if (best_eval >= beta_orig) entry.flag = tt::lower;
+        else entry.flag = tt::exact;
+        {
+            trace::slow_span store_span{"tt_store", "tt"};
+            trans_table->insert(context.hash, entry);
+        }
 
-        return val;
+        return best_eval;
+    }
+
+    // Black-positive score of the position with hash `key`, from the cache
+    // or else from `evaluator`. The hash covers stones and rules but not the
+    // evaluator, so the cache is cleared whenever the network changes.
+    template <typename Evaluator>
+    int cached_evaluate(uint64_t key, eval_counts &counts, Evaluator &&evaluator) {
+        if (!eval_cache_.enabled()) return evaluator();
+        if (const auto cached = eval_cache_.find(key)) {
+            ++counts.hits;
+            return *cached;
+        }
+        ++counts.misses;
+        const int score = evaluator();
+        eval_cache_.insert(key, score);
+        return score;
     }
 
-    int evaluate(const chess_info& board) {
+    // Active evaluator: the network when one is loaded, otherwise the pattern tables.
+    // The network never reports a win on its own, so five-in-a-row is checked
+    // explicitly and mapped onto the pattern evaluator's win score.
+    int evaluate(const state_type& board, const search_context& context) {
+        if (!context.network) {
+            return evaluate(board);
+        }
+        const point last = board.current_point;
+        if (last.is_on_board<Size>() && board.pieces[last.x][last.y] != 0 && context.runs.is_win(last, board.pieces[last.x][last.y])) {
+            return board.pieces[last.x][last.y] == black_piece ? win_score : -win_score;
+        }
+        return std::clamp(context.network->evaluate(context.accumulator), -(win_threshold - 1), win_threshold - 1);
+    }
+
+    int evaluate(const state_type& board) {
         int total_score = 0;
-        char buffer[16];
-
-        // Horizontal
-        for (int i : std::views::iota(1, 16)) {
-            int len = 0;
-            for (int j : std::views::iota(1, 16)) buffer[len++] = to_char(board.pieces[i][j]);
-            total_score += evaluate_line(buffer, len, score_table_black);
-            
-            len = 0;
-            for (int j : std::views::iota(1, 16)) buffer[len++] = to_char(board.pieces[i][j]);
-            total_score -= evaluate_line(buffer, len, score_table_white);
-        }
-        // Vertical
-        for (int j : std::views::iota(1, 16)) {
-            int len = 0;
-            for (int i : std::views::iota(1, 16)) buffer[len++] = to_char(board.pieces[i][j]);
-            total_score += evaluate_line(buffer, len, score_table_black);
-
-            len = 0;
-            for (int i : std::views::iota(1, 16)) buffer[len++] = to_char(board.pieces[i][j]);
-            total_score -= evaluate_line(buffer, len, score_table_white);
-        }
-        // Diagonal (1,1)
-        for (int k = 0; k < 15; ++k) {
-            int len = 0;
-            for (int x = 1 + k, y = 1; x <= 15 && y <= 15; ++x, ++y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score += evaluate_line(buffer, len, score_table_black);
-
-            len = 0;
-            for (int x = 1 + k, y = 1; x <= 15 && y <= 15; ++x, ++y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score -= evaluate_line(buffer, len, score_table_white);
-        }
-        for (int k = 1; k < 15; ++k) {
-            int len = 0;
-            for (int x = 1, y = 1 + k; x <= 15 && y <= 15; ++x, ++y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score += evaluate_line(buffer, len, score_table_black);
-
-            len = 0;
-            for (int x = 1, y = 1 + k; x <= 15 && y <= 15; ++x, ++y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score -= evaluate_line(buffer, len, score_table_white);
-        }
-        // Anti-diagonal (1, -1)
-        for (int k = 0; k < 15; ++k) {
-            int len = 0;
-            for (int x = 1, y = 1 + k; x <= 15 && y >= 1; ++x, --y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score += evaluate_line(buffer, len, score_table_black);
-
-            len = 0;
-            for (int x = 1, y = 1 + k; x <= 15 && y >= 1; ++x, --y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score -= evaluate_line(buffer, len, score_table_white);
-        }
-        for (int k = 1; k < 15; ++k) {
-            int len = 0;
-            for (int x = 1 + k, y = 15; x <= 15 && y >= 1; ++x, --y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score += evaluate_line(buffer, len, score_table_black);
-
-            len = 0;
-            for (int x = 1 + k, y = 15; x <= 15 && y >= 1; ++x, --y) buffer[len++] = to_char(board.pieces[x][y]);
-            total_score -= evaluate_line(buffer, len, score_table_white);
+        std::array<std::uint8_t, Size> cells;
+        for (const auto &[start, step, length] : board_lines<Size>) {
+            const auto read_line = [&] {
+                point p = start;
+                for (int k = 0; k < length; ++k, p += step) cells[k] = static_cast<std::uint8_t>(board.pieces[p.x][p.y]);
+            };
+            read_line();
+            total_score += evaluate_line(cells.data(), length, black_patterns);
+            read_line();
+            total_score -= evaluate_line(cells.data(), length, white_patterns);
         }
         return total_score;
     }
 
-    std::vector<point> get_moves(const chess_info& board) {
-        std::vector<point> moves;
+    void get_moves(const state_type& board, search::move_list& moves, const rule::basic_forbidden_map<Size>* excluded = nullptr) {
+        moves.clear();
         bool has_pieces = false;
-        for (int i : std::views::iota(1, 16)) {
-            for (int j : std::views::iota(1, 16)) {
+        for (int i : std::views::iota(1, Size + 1)) {
+            for (int j : std::views::iota(1, Size + 1)) {
                 if (board.pieces[i][j] != 0) {
                     has_pieces = true;
                     break;
@@ -491,34 +1113,36 @@ private:
         }
         
         if (!has_pieces) {
-            moves.push_back({8, 8});
-            return moves;
-        }
-
-        for (int i : std::views::iota(1, 16)) {
-            for (int j : std::views::iota(1, 16)) {
-                if (board.pieces[i][j] == 0) {
-                    bool neighbor = false;
-                    for (int dx : std::views::iota(-2, 3)) {
-                        for (int dy : std::views::iota(-2, 3)) {
-                            int nx = i + dx;
-                            int ny = j + dy;
-                            if (nx >= 1 && nx <= 15 && ny >= 1 && ny <= 15) {
-                                if (board.pieces[nx][ny] != 0) {
-                                    neighbor = true;
-                                    break;
-                                }
-                            }
-                        }
-                        if (neighbor) break;
-                    }
-                    if (neighbor) moves.push_back({i, j});
+            moves.push_back(center);
+            return;
+        }
+
+        for (int i : std::views::iota(1, Size + 1)) {
+            const std::uint32_t blocked = excluded ? excluded->row(i) : 0;
+            for (int j : std::views::iota(1, Size + 1)) {
+                if (board.pieces[i][j] == 0 && (blocked >> j & 1) == 0 && has_neighbor(board, {i, j})) {
+                    moves.push_back({i, j});
                 }
             }
         }
-        return moves;
+    }
+
+    // A stone within two cells of `p` in both directions.
+    [[nodiscard]] static bool has_neighbor(const state_type& board, point p) {
+        for (int dx : std::views::iota(-2, 3)) {
+            for (int dy : std::views::iota(-2, 3)) {
+                int nx = p.x + dx;
+                int ny = p.y + dy;
+                if (nx >= 1 && nx <= Size && ny >= 1 && ny <= Size && board.pieces[nx][ny] != 0) {
+                    return true;
+                }
+            }
+        }
+        return false;
     }
 };
 
+using engine = basic_engine<board_rows>;
+
 }  // namespace ai
 
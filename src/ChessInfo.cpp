@@ -5,19 +5,18 @@ export module chess_info;
 import point;
 import strings;
 
-export struct chess_info {
-    chess_info();
+// A position on a Size x Size board; pieces are indexed from 1.
+export template <int Size>
+    requires board_size<Size>
+struct basic_chess_info {
+    static constexpr int size = Size;
 
-    int pieces[16][16];
+    basic_chess_info() : pieces{}, turn{black_turn} {}
+
+    int pieces[Size + 1][Size + 1];
     int turn;
     int round{0};
     point current_point{-1, -1};
 };
 
-chess_info::chess_info() : pieces{}, turn{black_turn} {
-    for (auto &row : pieces) {
-        for (int &cell : row) {
-            cell = 0;
-        }
-    }
-}
+export using chess_info = basic_chess_info<board_rows>;
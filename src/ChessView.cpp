@@ -1,5 +1,18 @@
 module;
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
 export module chess_view;
 
 import std;
@@ -7,12 +20,15 @@ import std;
 import point;
 import strings;
 
-namespace {
-std::string cell_marker(int x, int y) {
+// Not exported, but outside an anonymous namespace: the board-size templates
+// below are instantiated in importing units and refer to these helpers.
+namespace chess_view {
+template <int Size>
+std::string_view cell_marker(int x, int y) {
     const bool left_edge = x == 1;
-    const bool right_edge = x == board_rows;
+    const bool right_edge = x == Size;
     const bool bottom_edge = y == 1;
-    const bool top_edge = y == board_cols;
+    const bool top_edge = y == Size;
 
     if ((left_edge || right_edge) && (bottom_edge || top_edge)) {
         if (left_edge && bottom_edge) {
@@ -44,35 +60,185 @@ std::string cell_marker(int x, int y) {
     }
     return "┼ ";
 }
-}  // namespace
 
-export namespace chess_view {
+// What a cell shows: the piece value, plus 2 for the last move.
+template <std::size_t N>
+char cell_code(const int (&board)[N][N], point current, int x, int y) {
+    const bool is_current = current.x == x && current.y == y;
+    return static_cast<char>(board[x][y] == 0 ? 0 : board[x][y] + (is_current ? 2 : 0));
+}
 
-void show_board(const int (&board)[16][16], point current) {
-    for (int y : std::views::iota(1, board_cols + 1) | std::views::reverse) {
-        std::cout << std::setw(2) << y;
-        for (int x : std::views::iota(1, board_rows + 1)) {
-            if (board[x][y] == 0) {
-                std::cout << cell_marker(x, y);
-            } else if (board[x][y] == white_piece) {
-                const bool is_current = current.x == x && current.y == y;
-                std::cout << (is_current ? "△ " : "○ ");
-            } else if (board[x][y] == black_piece) {
-                const bool is_current = current.x == x && current.y == y;
-                std::cout << (is_current ? "▲ " : "● ");
-            }
-        }
-        std::cout << '\n';
+template <int Size>
+std::string_view cell_glyph(char code, int x, int y) {
+    switch (code) {
+        case black_piece: return "● ";
+        case white_piece: return "○ ";
+        case black_piece + 2: return "▲ ";
+        case white_piece + 2: return "△ ";
+        default: return cell_marker<Size>(x, y);
+    }
+}
+
+template <std::size_t N>
+void append_row(std::string &out, const int (&board)[N][N], point current, int y) {
+    constexpr int size = static_cast<int>(N) - 1;
+    std::format_to(std::back_inserter(out), "{:2}", y);
+    for (int x = 1; x <= size; ++x) {
+        out += cell_glyph<size>(cell_code(board, current, x, y), x, y);
+    }
+}
+
+void append_footer(std::string &out, int size) {
+    out += ' ';
+    for (int x = 1; x <= size; ++x) {
+        out += ' ';
+        out += static_cast<char>('a' + x - 1);
     }
-    std::cout << " ";
-    for (int x : std::views::iota(1, board_rows + 1)) {
-        std::cout << std::setw(2) << static_cast<char>('a' + x - 1);
+}
+
+// How frames reach stdout.
+enum class output_mode {
+    ansi,   // a terminal that takes escape codes
+    cls,    // a Windows console without VT processing, cleared with cls
+    plain,  // not a terminal: whole frames, no escape codes
+};
+
+// On Windows this also turns VT processing on for the console.
+output_mode detect_output_mode() {
+#ifdef _WIN32
+    const HANDLE out = ::GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (out == INVALID_HANDLE_VALUE || !::GetConsoleMode(out, &mode)) {
+        return output_mode::plain;
     }
-    std::cout << '\n';
+    return ::SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING) ? output_mode::ansi : output_mode::cls;
+#else
+    return ::isatty(STDOUT_FILENO) ? output_mode::ansi : output_mode::plain;
+#endif
 }
 
+output_mode stdout_mode() {
+    static const output_mode mode = detect_output_mode();
+    return mode;
+}
+
+// Height of the terminal on stdout, or 0 when it cannot be determined.
+int terminal_rows() {
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info{};
+    if (::GetConsoleScreenBufferInfo(::GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+        return info.srWindow.Bottom - info.srWindow.Top + 1;
+    }
+#else
+    winsize size{};
+    if (::isatty(STDOUT_FILENO) && ::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+        return size.ws_row;
+    }
+#endif
+    return 0;
+}
+
+// Lines other code may print under a frame before the next one is drawn
+// (prompts, verdicts, "Waiting AI..."); a frame only updates in place if
+// those cannot have scrolled it.
+constexpr int trailing_lines = 6;
+}  // namespace chess_view
+
+export namespace chess_view {
+
+template <std::size_t N>
+void show_board(const int (&board)[N][N], point current) {
+    constexpr int size = static_cast<int>(N) - 1;
+    std::string out;
+    for (int y = size; y >= 1; --y) {
+        append_row(out, board, current, y);
+        out += '\n';
+    }
+    append_footer(out, size);
+    out += '\n';
+    std::cout << out;
+}
+
+template <int Size = board_rows>
 std::string marker_for_cell(int x, int y) {
-    return cell_marker(x, y);
+    return std::string(cell_marker<Size>(x, y));
 }
 
+// Draws the game screen (header, board, coordinates) with ANSI cursor
+// control. The whole frame is built in one buffer and written with a
+// single flush. The first frame, or one whose header changed, repaints the
+// screen; later ones rewrite only the board rows that changed and erase
+// whatever was printed below the board since. A Windows console without VT
+// processing is cleared with cls instead, and output that is not a
+// terminal gets every frame whole, without escape codes.
+template <int Size>
+class basic_renderer {
+public:
+    basic_renderer() { frame_.reserve(4096); }
+
+    void draw(const std::vector<std::string> &header_lines, const int (&board)[Size + 1][Size + 1], point current) {
+        frame_.clear();
+        const int first_row = static_cast<int>(header_lines.size()) + 2;  // 1-based screen row of y = Size
+        const int below = first_row + Size + 1;                           // first row under the coordinates
+        const auto mode = stdout_mode();
+        const int rows = mode == output_mode::ansi ? terminal_rows() : 0;
+        const bool repaint = !drawn_ || header_lines != header_ || rows == 0 || below + trailing_lines > rows;
+
+        if (repaint) {
+            if (mode == output_mode::ansi) {
+                frame_ += "\x1b[H\x1b[2J";
+            } else if (mode == output_mode::cls) {
+                std::cout.flush();
+                std::system("cls");
+            }
+            for (const auto &line : header_lines) {
+                frame_ += line;
+                frame_ += '\n';
+            }
+            frame_ += '\n';
+            for (int y = Size; y >= 1; --y) {
+                append_row(frame_, board, current, y);
+                frame_ += '\n';
+            }
+            append_footer(frame_, Size);
+            frame_ += "\n\n";
+            header_ = header_lines;
+        } else {
+            for (int y = Size; y >= 1; --y) {
+                bool changed = false;
+                for (int x = 1; x <= Size; ++x) {
+                    changed |= cells_[x][y] != cell_code(board, current, x, y);
+                }
+                if (changed) {
+                    // Whole rows rather than single cells: column offsets
+                    // would assume every glyph is one terminal cell wide.
+                    std::format_to(std::back_inserter(frame_), "\x1b[{};1H", first_row + Size - y);
+                    append_row(frame_, board, current, y);
+                }
+            }
+            std::format_to(std::back_inserter(frame_), "\x1b[{};1H\x1b[J\n", below);
+        }
+
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                cells_[x][y] = cell_code(board, current, x, y);
+            }
+        }
+        drawn_ = true;
+        std::cout.write(frame_.data(), static_cast<std::streamsize>(frame_.size()));
+        std::cout.flush();
+    }
+
+    // Forces the next frame to repaint the whole screen.
+    void invalidate() noexcept { drawn_ = false; }
+
+private:
+    std::string frame_;
+    std::vector<std::string> header_;
+    std::array<std::array<char, Size + 1>, Size + 1> cells_{};
+    bool drawn_ = false;
+};
+
+using renderer = basic_renderer<board_rows>;
+
 }  // namespace chess_view
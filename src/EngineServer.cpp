@@ -0,0 +1,538 @@
+module;
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+
+#include <spdlog/spdlog.h>
+#include <stdexec/execution.hpp>
+#include <exec/static_thread_pool.hpp>
+
+export module engine_server;
+
+import std;
+
+import ai;
+import chess_info;
+import memory;
+import point;
+import rule;
+import search_stack;
+import strings;
+import tool;
+import transposition_table;
+
+namespace {
+
+std::atomic<bool> stop_requested{false};
+
+void request_stop(int) {
+    stop_requested.store(true);
+}
+
+// Fixed window of recent move latencies.
+class latency_window {
+public:
+    void record(double ms) {
+        std::lock_guard lock(mutex_);
+        samples_[next_++ % samples_.size()] = ms;
+        count_ = std::min(count_ + 1, samples_.size());
+    }
+
+    [[nodiscard]] std::pair<double, double> p50_p99() const {
+        std::vector<double> sorted;
+        {
+            std::lock_guard lock(mutex_);
+            sorted.assign(samples_.begin(), samples_.begin() + static_cast<std::ptrdiff_t>(count_));
+        }
+        if (sorted.empty()) {
+            return {0.0, 0.0};
+        }
+        std::ranges::sort(sorted);
+        // Nearest rank.
+        const auto at = [&](double q) {
+            const auto rank = static_cast<std::size_t>(std::ceil(q * static_cast<double>(sorted.size())));
+            return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+        };
+        return {at(0.50), at(0.99)};
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::array<double, 4096> samples_{};
+    std::size_t next_ = 0;
+    std::size_t count_ = 0;
+};
+
+struct connection {
+    int fd;
+    std::mutex write_mutex;
+    std::string pending_input;
+
+    // Detaches from the descriptor first so a late BEST never reaches a
+    // new connection that reuses the same number.
+    void close() {
+        std::lock_guard lock(write_mutex);
+        ::close(fd);
+        fd = -1;
+    }
+
+    void send_line(std::string_view text) {
+        std::string line(text);
+        line.push_back('\n');
+        std::lock_guard lock(write_mutex);
+        if (fd < 0) {
+            return;
+        }
+        std::size_t sent = 0;
+        while (sent < line.size()) {
+            const auto n = ::send(fd, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+    }
+};
+
+struct game_session {
+    std::unique_ptr<ai::engine> engine;
+    chess_info state;
+    std::vector<point> history;
+    bool searching = false;
+};
+
+struct search_job {
+    std::shared_ptr<connection> client;
+    std::shared_ptr<game_session> session;
+    std::string id;
+    std::chrono::steady_clock::time_point received;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+}  // namespace
+
+export namespace server {
+
+struct server_options {
+    std::string unix_path;            // listen on this Unix socket when set
+    int tcp_port = 7878;              // otherwise on 127.0.0.1:tcp_port
+    unsigned search_threads = 0;      // shared pool size, 0: hardware threads
+    unsigned max_active = 0;          // concurrent searches, 0: search_threads
+    std::size_t max_queue = 256;      // queued GO requests beyond this get BUSY
+    std::size_t max_sessions = 4096;
+    std::size_t tt_megabytes = 512;   // total TT memory
+    bool shared_tt = true;            // one global TT, or equal per-session partitions
+    std::filesystem::path tt_snapshot;  // shared TT loaded at start and saved at stop
+    std::string tt_shared_memory;       // shared TT in this POSIX shared-memory segment
+    memory::placement tt_placement = memory::placement::interleave;  // TT pages on a NUMA host
+    int depth = 16;
+    std::chrono::milliseconds default_deadline{1000};
+};
+
+// Line protocol, one command per line; many sessions per connection:
+//   NEW <id> [renju|freestyle]   -> OK <id> | ERROR <id> ...
+//   MOVE <id> <move>             -> OK <id>          (e.g. MOVE g1 h8)
+//   UNDO <id> / CLOSE <id>       -> OK <id>
+//   GO <id> [deadline_ms]        -> BEST <id> <move> <score> <depth> <ms> | BUSY <id>
+//   STATS                        -> STATS sessions=.. active=.. queued=.. served=.. rejected=.. p50=.. p99=..
+class engine_server {
+public:
+    explicit engine_server(server_options options)
+        : options_(std::move(options)),
+          threads_(options_.search_threads != 0 ? options_.search_threads
+                                                : std::max(1u, std::thread::hardware_concurrency())),
+          pool_(threads_),
+          stacks_(std::make_shared<search::stack_arena>(threads_)) {
+        if (!options_.tt_shared_memory.empty()) {
+            // No fallback to a private table: the caller asked to share it.
+            shared_table_ = tt::table::open_shared(options_.tt_shared_memory, options_.tt_megabytes,
+                                                   ai::snapshot_signature(ai::default_network().get()));
+            if (!shared_table_) return;
+        } else if (options_.shared_tt) {
+            shared_table_ = std::make_shared<tt::table>(options_.tt_megabytes, options_.tt_placement);
+        }
+        if (shared_table_) {
+            std::error_code error;
+            if (!options_.tt_snapshot.empty() && std::filesystem::exists(options_.tt_snapshot, error)) {
+                if (const auto loaded = shared_table_->load(options_.tt_snapshot, ai::snapshot_signature(ai::default_network().get()))) {
+                    spdlog::info("engine server: {} TT entries loaded from {}", *loaded, options_.tt_snapshot.string());
+                }
+            }
+        }
+        const unsigned active = options_.max_active != 0 ? options_.max_active : threads_;
+        for (unsigned i = 0; i < active; ++i) {
+            dispatchers_.emplace_back([this](std::stop_token stop) { dispatch(stop); });
+        }
+    }
+
+    ~engine_server() {
+        for (auto &dispatcher : dispatchers_) {
+            dispatcher.request_stop();
+        }
+        queue_cv_.notify_all();
+        dispatchers_.clear();
+    }
+
+    // Serves until SIGINT/SIGTERM. Returns false if the socket cannot be opened.
+    // False when the shared-memory TT asked for could not be opened; the
+    // server must not run then.
+    [[nodiscard]] bool ready() const noexcept { return options_.tt_shared_memory.empty() || shared_table_; }
+
+    bool run() {
+        if (!ready()) {
+            return false;
+        }
+        const int listener = open_listener();
+        if (listener < 0) {
+            return false;
+        }
+        std::signal(SIGINT, request_stop);
+        std::signal(SIGTERM, request_stop);
+
+        std::map<int, std::shared_ptr<connection>> clients;
+        std::vector<pollfd> fds;
+        while (!stop_requested.load()) {
+            fds.clear();
+            fds.push_back(pollfd{listener, POLLIN, 0});
+            for (const auto &[fd, client] : clients) {
+                fds.push_back(pollfd{fd, POLLIN, 0});
+            }
+            if (::poll(fds.data(), fds.size(), 200) <= 0) {
+                continue;
+            }
+            if ((fds[0].revents & POLLIN) != 0) {
+                const int fd = ::accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    clients.emplace(fd, std::make_shared<connection>(fd));
+                }
+            }
+            for (const auto &entry : std::span(fds).subspan(1)) {
+                if ((entry.revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+                    continue;
+                }
+                auto client = clients.at(entry.fd);
+                std::array<char, 4096> buffer{};
+                const auto n = ::recv(entry.fd, buffer.data(), buffer.size(), 0);
+                if (n <= 0) {
+                    close_sessions(*client);
+                    client->close();
+                    clients.erase(entry.fd);
+                    continue;
+                }
+                client->pending_input.append(buffer.data(), static_cast<std::size_t>(n));
+                std::size_t newline = 0;
+                while ((newline = client->pending_input.find('\n')) != std::string::npos) {
+                    const std::string line = client->pending_input.substr(0, newline);
+                    client->pending_input.erase(0, newline + 1);
+                    handle(client, line);
+                }
+            }
+        }
+
+        for (const auto &[fd, client] : clients) {
+            client->close();
+        }
+        ::close(listener);
+        if (!options_.unix_path.empty()) {
+            ::unlink(options_.unix_path.c_str());
+        }
+        if (shared_table_ && !options_.tt_snapshot.empty()) {
+            shared_table_->save(options_.tt_snapshot, ai::snapshot_signature(ai::default_network().get()));
+        }
+        spdlog::info("engine server stopped: {}", stats_line());
+        return true;
+    }
+
+    [[nodiscard]] std::string stats_line() const {
+        const auto [p50, p99] = latencies_.p50_p99();
+        std::size_t sessions = 0;
+        std::size_t queued = 0;
+        {
+            std::lock_guard lock(sessions_mutex_);
+            sessions = sessions_.size();
+        }
+        {
+            std::lock_guard lock(queue_mutex_);
+            queued = queue_.size();
+        }
+        return std::format("STATS sessions={} active={} queued={} served={} rejected={} p50={:.1f}ms p99={:.1f}ms",
+                           sessions, active_.load(), queued, served_.load(), rejected_.load(), p50, p99);
+    }
+
+private:
+    int open_listener() {
+        int fd = -1;
+        if (!options_.unix_path.empty()) {
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (options_.unix_path.size() >= sizeof(address.sun_path)) {
+                spdlog::error("engine server: socket path too long: {}", options_.unix_path);
+                ::close(fd);
+                return -1;
+            }
+            std::ranges::copy(options_.unix_path, address.sun_path);
+            ::unlink(options_.unix_path.c_str());
+            if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+                spdlog::error("engine server: cannot bind {}", options_.unix_path);
+                ::close(fd);
+                return -1;
+            }
+        } else {
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            const int reuse = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<std::uint16_t>(options_.tcp_port));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+                spdlog::error("engine server: cannot bind 127.0.0.1:{}", options_.tcp_port);
+                ::close(fd);
+                return -1;
+            }
+        }
+        if (::listen(fd, 64) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    [[nodiscard]] static std::string session_key(const connection &client, std::string_view id) {
+        return std::format("{}:{}", client.fd, id);
+    }
+
+    [[nodiscard]] std::shared_ptr<game_session> find_session(const connection &client, std::string_view id) {
+        std::lock_guard lock(sessions_mutex_);
+        const auto it = sessions_.find(session_key(client, id));
+        return it == sessions_.end() ? nullptr : it->second;
+    }
+
+    void close_sessions(const connection &client) {
+        const auto prefix = std::format("{}:", client.fd);
+        std::lock_guard lock(sessions_mutex_);
+        std::erase_if(sessions_, [&](const auto &entry) { return entry.first.starts_with(prefix); });
+    }
+
+    [[nodiscard]] std::unique_ptr<ai::engine> make_engine(rule::variant rules) const {
+        ai::engine_options config{.depth = options_.depth, .rules = rules, .threads = threads_};
+        config.pool = &pool_;
+        config.stacks = stacks_;
+        if (shared_table_) {
+            config.table = shared_table_;
+        } else {
+            config.tt_megabytes = std::max<std::size_t>(1, options_.tt_megabytes / options_.max_sessions);
+            config.tt_placement = options_.tt_placement;
+        }
+        config.solver_megabytes = 1;  // one per session
+        config.eval_cache_megabytes = 1;
+        return std::make_unique<ai::engine>(config);
+    }
+
+    void handle(const std::shared_ptr<connection> &client, std::string_view line) {
+        std::vector<std::string_view> words;
+        for (auto word : line | std::views::split(' ')) {
+            if (!word.empty()) words.emplace_back(word.begin(), word.end());
+        }
+        if (!words.empty() && words.back().ends_with('\r')) {
+            words.back().remove_suffix(1);
+        }
+        if (words.empty()) {
+            return;
+        }
+        const auto command = words[0];
+        if (command == "STATS") {
+            client->send_line(stats_line());
+            return;
+        }
+        if (words.size() < 2) {
+            client->send_line("ERROR missing session id");
+            return;
+        }
+        const std::string id(words[1]);
+
+        if (command == "NEW") {
+            const auto rules = words.size() > 2 && words[2] == "freestyle" ? rule::variant::freestyle : rule::variant::renju;
+            // The slot is reserved before the engine, and its TT, is built,
+            // so a full server turns the session away without allocating.
+            {
+                std::lock_guard lock(sessions_mutex_);
+                if (sessions_.size() + pending_sessions_ >= options_.max_sessions) {
+                    client->send_line(std::format("ERROR {} too many sessions", id));
+                    return;
+                }
+                ++pending_sessions_;
+            }
+            auto session = std::make_shared<game_session>();
+            session->engine = make_engine(rules);
+            std::lock_guard lock(sessions_mutex_);
+            --pending_sessions_;
+            sessions_[session_key(*client, id)] = std::move(session);
+            client->send_line(std::format("OK {}", id));
+            return;
+        }
+        if (command == "CLOSE") {
+            std::lock_guard lock(sessions_mutex_);
+            sessions_.erase(session_key(*client, id));
+            client->send_line(std::format("OK {}", id));
+            return;
+        }
+
+        auto session = find_session(*client, id);
+        if (!session) {
+            client->send_line(std::format("ERROR {} unknown session", id));
+            return;
+        }
+        std::unique_lock session_lock(session_mutex_);
+        if (session->searching) {
+            client->send_line(std::format("ERROR {} search in progress", id));
+            return;
+        }
+
+        if (command == "MOVE" && words.size() > 2) {
+            const auto move = tool::parse_move(words[2]);
+            if (!move || session->state.pieces[move->x][move->y] != 0) {
+                client->send_line(std::format("ERROR {} invalid move", id));
+                return;
+            }
+            place(*session, *move);
+            client->send_line(std::format("OK {}", id));
+        } else if (command == "UNDO") {
+            if (!session->history.empty()) {
+                const point last = session->history.back();
+                session->history.pop_back();
+                session->state.pieces[last.x][last.y] = 0;
+                session->state.current_point = session->history.empty() ? point{-1, -1} : session->history.back();
+                session->state.turn ^= 1;
+                session->state.round -= 1;
+            }
+            client->send_line(std::format("OK {}", id));
+        } else if (command == "GO") {
+            int deadline_ms = static_cast<int>(options_.default_deadline.count());
+            if (words.size() > 2) {
+                std::from_chars(words[2].data(), words[2].data() + words[2].size(), deadline_ms);
+            }
+            const auto now = std::chrono::steady_clock::now();
+            std::lock_guard queue_lock(queue_mutex_);
+            if (queue_.size() >= options_.max_queue) {
+                ++rejected_;
+                client->send_line(std::format("BUSY {}", id));
+                return;
+            }
+            session->searching = true;
+            queue_.push_back(search_job{client, session, id, now, now + std::chrono::milliseconds{deadline_ms}});
+            queue_cv_.notify_one();
+        } else {
+            client->send_line(std::format("ERROR {} unknown command {}", id, command));
+        }
+    }
+
+    static void place(game_session &session, point move) {
+        session.state.pieces[move.x][move.y] = session.state.turn == black_turn ? black_piece : white_piece;
+        session.state.current_point = move;
+        session.state.turn ^= 1;
+        session.state.round += 1;
+        session.history.push_back(move);
+    }
+
+    // Dispatcher threads only wait on searches; the search itself runs on
+    // the shared pool, so a blocked dispatcher never starves the workers.
+    void dispatch(std::stop_token stop) {
+        while (true) {
+            search_job job;
+            {
+                std::unique_lock lock(queue_mutex_);
+                queue_cv_.wait(lock, stop, [&] { return !queue_.empty(); });
+                if (stop.stop_requested()) {
+                    return;
+                }
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            ++active_;
+            const point move = job.session->engine->get_best_point(job.session->state, job.deadline);
+            const auto &searched = job.session->engine->last_search();
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.received).count();
+            {
+                std::lock_guard lock(session_mutex_);
+                job.session->searching = false;
+                if (move.is_valid()) {
+                    place(*job.session, move);
+                }
+            }
+            --active_;
+            ++served_;
+            latencies_.record(ms);
+            job.client->send_line(std::format("BEST {} {} {} {} {:.1f}", job.id,
+                                              move.is_valid() ? tool::format_move(move) : std::string("none"),
+                                              searched.score, searched.depth, ms));
+        }
+    }
+
+    server_options options_;
+    unsigned threads_;
+    mutable exec::static_thread_pool pool_;
+    std::shared_ptr<search::stack_arena> stacks_;
+    std::shared_ptr<tt::table> shared_table_;
+
+    mutable std::mutex sessions_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<game_session>> sessions_;
+    std::size_t pending_sessions_ = 0;  // NEW between the size check and the insert
+    std::mutex session_mutex_;  // guards game_session state against the dispatchers
+
+    mutable std::mutex queue_mutex_;
+    std::condition_variable_any queue_cv_;
+    std::deque<search_job> queue_;
+
+    std::atomic<int> active_{0};
+    std::atomic<std::uint64_t> served_{0};
+    std::atomic<std::uint64_t> rejected_{0};
+    latency_window latencies_;
+
+    std::vector<std::jthread> dispatchers_;  // last: joined before the rest is destroyed
+};
+
+// Reads --unix <path>, --port N, --threads N, --max-active N, --max-queue N,
+// --max-sessions N, --tt-mb N, --tt-partitioned, --tt-snapshot file, --tt-shm name,
+// --tt-numa interleave|partition, --depth N, --deadline-ms N.
+[[nodiscard]] std::optional<server_options> parse_options(const std::vector<std::string_view> &args) {
+    server_options options;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const auto flag = args[i];
+        if (flag == "--serve") continue;
+        if (flag == "--tt-partitioned") {
+            options.shared_tt = false;
+            continue;
+        }
+        if (i + 1 >= args.size()) return std::nullopt;
+        const auto value = args[++i];
+        long long number = 0;
+        const bool numeric = std::from_chars(value.data(), value.data() + value.size(), number).ec == std::errc{} && number >= 0;
+        if (flag == "--unix") options.unix_path = std::string(value);
+        else if (flag == "--tt-snapshot") options.tt_snapshot = std::filesystem::path{value};
+        else if (flag == "--tt-shm") options.tt_shared_memory = std::string(value);
+        else if (flag == "--tt-numa" && (value == "interleave" || value == "partition")) {
+            options.tt_placement = value == "partition" ? memory::placement::partition : memory::placement::interleave;
+        }
+        else if (flag == "--port" && numeric) options.tcp_port = static_cast<int>(number);
+        else if (flag == "--threads" && numeric) options.search_threads = static_cast<unsigned>(number);
+        else if (flag == "--max-active" && numeric) options.max_active = static_cast<unsigned>(number);
+        else if (flag == "--max-queue" && numeric) options.max_queue = static_cast<std::size_t>(number);
+        else if (flag == "--max-sessions" && numeric && number > 0) options.max_sessions = static_cast<std::size_t>(number);
+        else if (flag == "--tt-mb" && numeric) options.tt_megabytes = static_cast<std::size_t>(number);
+        else if (flag == "--depth" && numeric) options.depth = static_cast<int>(number);
+        else if (flag == "--deadline-ms" && numeric) options.default_deadline = std::chrono::milliseconds{number};
+        else if (flag != "--nnue" && flag != "--trace") return std::nullopt;
+    }
+    // A shared-memory table is one global table.
+    if (!options.tt_shared_memory.empty() && !options.shared_tt) return std::nullopt;
+    return options;
+}
+
+}  // namespace server
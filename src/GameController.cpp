@@ -15,14 +15,6 @@ using namespace std::chrono_literals;
 
 namespace {
 
-void clear_screen() {
-#ifdef _WIN32
-    std::system("cls");
-#else
-    std::system("clear");
-#endif
-}
-
 void pause_with_message(std::string_view message) {
     std::cout << message;
     std::cout.flush();
@@ -30,16 +22,6 @@ void pause_with_message(std::string_view message) {
     std::cin.get();
 }
 
-void render_board(const std::vector<std::string> &header_lines, const chess_info &state) {
-    clear_screen();
-    for (const auto &line : header_lines) {
-        std::cout << line << '\n';
-    }
-    std::cout << '\n';
-    chess_view::show_board(state.pieces, state.current_point);
-    std::cout << '\n';
-}
-
 std::string describe_piece(int piece_value) {
     return piece_value == black_piece ? "black" : "white";
 }
@@ -52,20 +34,108 @@ std::string format_seconds(double seconds) {
 
 export namespace game {
 
+enum class move_error { none, invalid_coordinate, occupied, off_center };
+
+// Checks a proposed move before it is placed.
+[[nodiscard]] move_error validate_move(const chess_info &state, point move, int piece, bool enforce_center, int move_count) {
+    if (!move.is_valid()) {
+        return move_error::invalid_coordinate;
+    }
+    if (!move.is_empty(state.pieces)) {
+        return move_error::occupied;
+    }
+    if (enforce_center && move_count == 0 && piece == black_piece && (move.x != 8 || move.y != 8)) {
+        return move_error::off_center;
+    }
+    return move_error::none;
+}
+
+enum class outcome { ongoing, black_wins, white_wins, draw };
+
+enum class end_reason { none, five, double_three, double_four, long_chain, board_full, forfeit };
+
+struct adjudication {
+    outcome result = outcome::ongoing;
+    end_reason reason = end_reason::none;
+};
+
+// Decides the game after `piece` has been placed at `move`; `move_count`
+// includes that move. Black's forbidden shapes lose, white's long chain wins.
+[[nodiscard]] adjudication adjudicate(const chess_info &state, point move, int piece, int move_count) {
+    const bool won = rule::is_win(state.pieces, move);
+    const bool long_chain = rule::is_long_chain(state.pieces, move, piece);
+    const outcome mover_wins = piece == black_piece ? outcome::black_wins : outcome::white_wins;
+
+    if (won || (piece == white_piece && long_chain)) {
+        return {mover_wins, won ? end_reason::five : end_reason::long_chain};
+    }
+    if (piece == black_piece) {
+        if (rule::is_double_three(state.pieces, move)) {
+            return {outcome::white_wins, end_reason::double_three};
+        }
+        if (rule::is_double_four(state.pieces, move)) {
+            return {outcome::white_wins, end_reason::double_four};
+        }
+        if (long_chain) {
+            return {outcome::white_wins, end_reason::long_chain};
+        }
+    }
+    if (move_count == board_rows * board_cols) {
+        return {outcome::draw, end_reason::board_full};
+    }
+    return {};
+}
+
+[[nodiscard]] std::string_view to_string(outcome value) noexcept {
+    switch (value) {
+        case outcome::black_wins: return "black";
+        case outcome::white_wins: return "white";
+        case outcome::draw: return "draw";
+        case outcome::ongoing: break;
+    }
+    return "ongoing";
+}
+
+[[nodiscard]] std::string_view to_string(end_reason value) noexcept {
+    switch (value) {
+        case end_reason::five: return "five";
+        case end_reason::double_three: return "double_three";
+        case end_reason::double_four: return "double_four";
+        case end_reason::long_chain: return "long_chain";
+        case end_reason::board_full: return "board_full";
+        case end_reason::forfeit: return "forfeit";
+        case end_reason::none: break;
+    }
+    return "none";
+}
+
+struct played_move {
+    point move;
+    double seconds = 0.0;
+    std::optional<int> score;  // engine's score for the mover, if any
+};
+
+struct game_log {
+    std::vector<played_move> moves;
+    adjudication verdict;  // ongoing if a player quit
+};
+
 struct game_options {
     std::vector<std::string> header_lines;
     bool enforce_center = true;
     bool show_ai_thinking = true;
 };
 
-void run_game(const game_options &options,
-              player::player_base &black_player,
-              player::player_base &white_player) {
+game_log run_game(const game_options &options,
+                  player::player_base &black_player,
+                  player::player_base &white_player) {
     chess_info state;
     int move_count = 0;
+    game_log log;
+    chess_view::renderer view;
 
     while (true) {
-        render_board(options.header_lines, state);
+        view.draw(options.header_lines, state.pieces, state.current_point);
         auto &current_player = (state.turn == black_turn) ? black_player : white_player;
 
         const auto move_start = std::chrono::steady_clock::now();
@@ -77,67 +147,49 @@ void run_game(const game_options &options,
             std::cout << current_player.label() << " spent " << format_seconds(move_duration_s) << " s before quitting." << '\n';
             std::cout << current_player.label() << " quits the game." << '\n';
             pause_with_message("\nPlease press Enter to quit...");
-            return;
+            return log;
         }
 
         point move = *move_opt;
-        if (!move.is_valid()) {
-            pause_with_message("\nInvalid coordinate. Press Enter to continue...");
-            continue;
-        }
-        if (!move.is_empty(state.pieces)) {
-            pause_with_message("\nThe chosen cell is not empty. Press Enter to continue...");
-            continue;
-        }
-        if (options.enforce_center && move_count == 0 && current_player.piece_value() == black_piece && (move.x != 8 || move.y != 8)) {
-            pause_with_message("\nThe first step of black piece needs to be in H8.\nPress Enter to continue...");
-            continue;
+        switch (validate_move(state, move, current_player.piece_value(), options.enforce_center, move_count)) {
+            case move_error::invalid_coordinate:
+                pause_with_message("\nInvalid coordinate. Press Enter to continue...");
+                continue;
+            case move_error::occupied:
+                pause_with_message("\nThe chosen cell is not empty. Press Enter to continue...");
+                continue;
+            case move_error::off_center:
+                pause_with_message("\nThe first step of black piece needs to be in H8.\nPress Enter to continue...");
+                continue;
+            case move_error::none:
+                break;
         }
 
         state.pieces[move.x][move.y] = current_player.piece_value();
         state.current_point = move;
         ++move_count;
+        log.moves.push_back(played_move{move, move_duration_s, current_player.last_score()});
 
-        render_board(options.header_lines, state);
+        view.draw(options.header_lines, state.pieces, state.current_point);
         pause_with_message(std::format("{} spent {} s on the move. Press Enter to continue...", current_player.label(), format_seconds(move_duration_s)));
 
-        const bool won = rule::is_win(state.pieces, move);
-        const bool long_chain = rule::is_long_chain(state.pieces, move, current_player.piece_value());
-        bool banned = false;
-        std::string banned_message;
-
-        if (current_player.piece_value() == black_piece) {
-            if (rule::is_double_three(state.pieces, move)) {
-                banned = true;
-                banned_message = "三三禁手, 白棋赢!";
-            } else if (rule::is_double_four(state.pieces, move)) {
-                banned = true;
-                banned_message = "四四禁手, 白棋赢!";
-            } else if (long_chain) {
-                banned = true;
-                banned_message = "长链, 白棋赢!";
+        const auto verdict = adjudicate(state, move, current_player.piece_value(), move_count);
+        log.verdict = verdict;
+        if (verdict.result != outcome::ongoing) {
+            view.draw(options.header_lines, state.pieces, state.current_point);
+            if (verdict.result == outcome::draw) {
+                std::cout << "和棋" << '\n';
+            } else if (verdict.result == outcome::white_wins && current_player.piece_value() == black_piece) {
+                switch (verdict.reason) {
+                    case end_reason::double_three: std::cout << "三三禁手, 白棋赢!" << '\n'; break;
+                    case end_reason::double_four: std::cout << "四四禁手, 白棋赢!" << '\n'; break;
+                    default: std::cout << "长链, 白棋赢!" << '\n'; break;
+                }
+            } else {
+                std::cout << describe_piece(current_player.piece_value()) << " piece win!" << '\n';
             }
-        }
-
-        if (won || (current_player.piece_value() == white_piece && long_chain)) {
-            render_board(options.header_lines, state);
-            std::cout << describe_piece(current_player.piece_value()) << " piece win!" << '\n';
-            pause_with_message("\nPlease press Enter to quit...");
-            return;
-        }
-
-        if (banned) {
-            render_board(options.header_lines, state);
-            std::cout << banned_message << '\n';
-            pause_with_message("\nPlease press Enter to quit...");
-            return;
-        }
-
-        if (move_count == board_rows * board_cols) {
-            render_board(options.header_lines, state);
-            std::cout << "和棋" << '\n';
             pause_with_message("\nPlease press Enter to quit...");
-            return;
+            return log;
         }
 
         state.turn ^= 1;
@@ -6,10 +6,14 @@ import std;
 
 import ai;
 import game_controller;
+import game_record;
 import player;
+import rule;
 
 namespace {
 
+std::filesystem::path record_path;
+
 enum class difficulty {
     easy,
     medium,
@@ -159,10 +163,24 @@ bool configure_players(std::string_view mode_name,
     return true;
 }
 
+void save_game(const player::player_base &black, const player::player_base &white, const game::game_log &log) {
+    if (record_path.empty() || log.moves.empty()) {
+        return;
+    }
+    if (auto out = record::writer::open(record_path)) {
+        out->append(record::from_log(black.label(), white.label(), rule::variant::renju, log));
+    }
+}
+
 }  // namespace
 
 export namespace game_modes {
 
+// Appends every finished or abandoned game to `path`; empty disables it.
+void set_record_path(std::filesystem::path path) {
+    record_path = std::move(path);
+}
+
 void run_pvp() {
     std::unique_ptr<player::player_base> black_player;
     std::unique_ptr<player::player_base> white_player;
@@ -177,7 +195,7 @@ void run_pvp() {
         .show_ai_thinking = true
     };
 
-    game::run_game(options, *black_player, *white_player);
+    save_game(*black_player, *white_player, game::run_game(options, *black_player, *white_player));
 }
 
 void run_pvm() {
@@ -194,7 +212,7 @@ void run_pvm() {
         .show_ai_thinking = true
     };
 
-    game::run_game(options, *black_player, *white_player);
+    save_game(*black_player, *white_player, game::run_game(options, *black_player, *white_player));
 }
 
 }  // namespace game_modes
@@ -0,0 +1,477 @@
+module;
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+export module game_record;
+
+import std;
+
+import game_controller;
+import point;
+import rule;
+import strings;
+import tool;
+
+// Record file layout (little endian):
+//   char     magic[8]        "GMKREC\0\0"
+//   uint32   version         record_version
+//   uint32   board_size      board_rows
+// followed by records, each:
+//   uint32   size            bytes in this record, header included
+//   uint8    rules           rule::variant
+//   uint8    result          game::outcome (ongoing: abandoned)
+//   uint8    reason          game::end_reason
+//   uint8    flags           bit 0: per-move stats present
+//   uint16   move_count
+//   uint8    black_length
+//   uint8    white_length
+//   char     black[black_length], white[white_length]
+//   uint8    moves[move_count]           (x - 1) * board_cols + (y - 1)
+//   uint16   time_ms[move_count]         if flags & 1, saturating
+//   int16    score[move_count]           if flags & 1, mover's view, saturating
+//
+// Records are only ever appended; a truncated last record (interrupted
+// writer) ends iteration instead of failing the file.
+
+namespace {
+
+constexpr std::array<char, 8> record_magic{'G', 'M', 'K', 'R', 'E', 'C', '\0', '\0'};
+constexpr std::uint32_t record_version = 1;
+constexpr std::size_t file_header_size = 16;
+constexpr std::size_t record_header_size = 12;
+constexpr std::uint8_t flag_stats = 1;
+
+template <typename T>
+void put(std::string &out, T value) {
+    using unsigned_t = std::make_unsigned_t<T>;
+    const auto bits = static_cast<unsigned_t>(value);
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+template <typename T>
+[[nodiscard]] T get(const std::byte *data) noexcept {
+    std::make_unsigned_t<T> bits = 0;
+    for (std::size_t i = 0; i < sizeof(T); ++i) {
+        bits |= static_cast<std::make_unsigned_t<T>>(std::to_integer<unsigned>(data[i])) << (8 * i);
+    }
+    return static_cast<T>(bits);
+}
+
+[[nodiscard]] std::string_view to_string(rule::variant rules) noexcept {
+    return rules == rule::variant::freestyle ? "freestyle" : "renju";
+}
+
+template <typename Enum>
+[[nodiscard]] std::optional<Enum> parse_enum(std::string_view text, int last) {
+    for (int i = 0; i <= last; ++i) {
+        if (game::to_string(static_cast<Enum>(i)) == text) {
+            return static_cast<Enum>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+}  // namespace
+
+export namespace record {
+
+struct game_record {
+    std::string black;
+    std::string white;
+    rule::variant rules = rule::variant::renju;
+    game::adjudication verdict;
+    std::vector<point> moves;
+    // Either empty or one entry per move.
+    std::vector<std::uint16_t> times_ms;
+    std::vector<std::int16_t> scores;
+
+    void add_move(point move) { moves.push_back(move); }
+
+    void add_move(point move, double seconds, int score) {
+        moves.push_back(move);
+        times_ms.push_back(static_cast<std::uint16_t>(std::lround(std::clamp(seconds * 1000.0, 0.0, 65535.0))));
+        scores.push_back(static_cast<std::int16_t>(std::clamp(score, -32767, 32767)));
+    }
+
+    [[nodiscard]] bool has_stats() const noexcept {
+        return !moves.empty() && times_ms.size() == moves.size() && scores.size() == moves.size();
+    }
+};
+
+[[nodiscard]] game_record from_log(std::string black, std::string white, rule::variant rules, const game::game_log &log) {
+    game_record result{.black = std::move(black), .white = std::move(white), .rules = rules, .verdict = log.verdict};
+    for (const auto &played : log.moves) {
+        result.add_move(played.move, played.seconds, played.score.value_or(0));
+    }
+    return result;
+}
+
+// Non-owning view of one record inside a mapped file.
+class game_view {
+public:
+    game_view() = default;
+    game_view(const std::byte *data, std::uint32_t size) noexcept : data_{data}, size_{size} {}
+
+    [[nodiscard]] std::uint32_t byte_size() const noexcept { return size_; }
+    [[nodiscard]] rule::variant rules() const noexcept { return static_cast<rule::variant>(std::to_integer<int>(data_[4])); }
+    [[nodiscard]] game::adjudication verdict() const noexcept {
+        return {static_cast<game::outcome>(std::to_integer<int>(data_[5])),
+                static_cast<game::end_reason>(std::to_integer<int>(data_[6]))};
+    }
+    [[nodiscard]] bool has_stats() const noexcept { return (std::to_integer<unsigned>(data_[7]) & flag_stats) != 0; }
+    [[nodiscard]] int move_count() const noexcept { return get<std::uint16_t>(data_ + 8); }
+
+    [[nodiscard]] std::string_view black() const noexcept {
+        return {reinterpret_cast<const char *>(data_ + record_header_size), black_length()};
+    }
+    [[nodiscard]] std::string_view white() const noexcept {
+        return {reinterpret_cast<const char *>(data_ + record_header_size + black_length()), white_length()};
+    }
+
+    // Raw move bytes, (x - 1) * board_cols + (y - 1).
+    [[nodiscard]] std::span<const std::byte> move_bytes() const noexcept {
+        return {moves_begin(), static_cast<std::size_t>(move_count())};
+    }
+    [[nodiscard]] point move(int index) const noexcept {
+        const int code = std::to_integer<int>(moves_begin()[index]);
+        return {code / board_cols + 1, code % board_cols + 1};
+    }
+    [[nodiscard]] int time_ms(int index) const noexcept {
+        return get<std::uint16_t>(moves_begin() + move_count() + 2 * index);
+    }
+    [[nodiscard]] int score(int index) const noexcept {
+        return get<std::int16_t>(moves_begin() + 3 * move_count() + 2 * index);
+    }
+
+    [[nodiscard]] game_record to_record() const {
+        game_record result{.black = std::string(black()), .white = std::string(white()), .rules = rules(), .verdict = verdict()};
+        for (int i = 0; i < move_count(); ++i) {
+            if (has_stats()) {
+                result.add_move(move(i), time_ms(i) / 1000.0, score(i));
+            } else {
+                result.add_move(move(i));
+            }
+        }
+        return result;
+    }
+
+    // Checks that the declared lengths fit inside `size`.
+    [[nodiscard]] bool fits() const noexcept {
+        if (size_ < record_header_size) {
+            return false;
+        }
+        const std::size_t per_move = has_stats() ? 5 : 1;
+        return record_header_size + black_length() + white_length() + per_move * move_count() == size_;
+    }
+
+    // Checks the lengths, and that every move is a cell of the board that
+    // no earlier move took.
+    [[nodiscard]] bool consistent() const noexcept {
+        if (!fits()) {
+            return false;
+        }
+        std::bitset<board_rows * board_cols> taken;
+        for (const auto byte : move_bytes()) {
+            const auto code = std::to_integer<std::size_t>(byte);
+            if (code >= taken.size() || taken.test(code)) {
+                return false;
+            }
+            taken.set(code);
+        }
+        return true;
+    }
+
+private:
+    [[nodiscard]] std::size_t black_length() const noexcept { return std::to_integer<std::size_t>(data_[10]); }
+    [[nodiscard]] std::size_t white_length() const noexcept { return std::to_integer<std::size_t>(data_[11]); }
+    [[nodiscard]] const std::byte *moves_begin() const noexcept {
+        return data_ + record_header_size + black_length() + white_length();
+    }
+
+    const std::byte *data_ = nullptr;
+    std::uint32_t size_ = 0;
+};
+
+[[nodiscard]] std::string encode(const game_record &game) {
+    const std::string_view black = std::string_view(game.black).substr(0, 255);
+    const std::string_view white = std::string_view(game.white).substr(0, 255);
+    const auto count = std::min<std::size_t>(game.moves.size(), board_rows * board_cols);
+    const bool stats = game.has_stats();
+
+    std::string out;
+    out.reserve(record_header_size + black.size() + white.size() + count * (stats ? 5 : 1));
+    put<std::uint32_t>(out, 0);
+    put<std::uint8_t>(out, static_cast<std::uint8_t>(game.rules));
+    put<std::uint8_t>(out, static_cast<std::uint8_t>(game.verdict.result));
+    put<std::uint8_t>(out, static_cast<std::uint8_t>(game.verdict.reason));
+    put<std::uint8_t>(out, stats ? flag_stats : 0);
+    put<std::uint16_t>(out, static_cast<std::uint16_t>(count));
+    put<std::uint8_t>(out, static_cast<std::uint8_t>(black.size()));
+    put<std::uint8_t>(out, static_cast<std::uint8_t>(white.size()));
+    out.append(black);
+    out.append(white);
+    for (std::size_t i = 0; i < count; ++i) {
+        put<std::uint8_t>(out, static_cast<std::uint8_t>((game.moves[i].x - 1) * board_cols + (game.moves[i].y - 1)));
+    }
+    if (stats) {
+        for (std::size_t i = 0; i < count; ++i) put<std::uint16_t>(out, game.times_ms[i]);
+        for (std::size_t i = 0; i < count; ++i) put<std::int16_t>(out, game.scores[i]);
+    }
+    const auto size = static_cast<std::uint32_t>(out.size());
+    for (std::size_t i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+    }
+    return out;
+}
+
+// Appends whole records; each append is one write followed by a flush.
+// Not thread-safe: callers that share a writer serialize appends.
+class writer {
+public:
+    // Returns nullptr (and logs the reason) if the file cannot be opened or
+    // is not a record file of this version.
+    [[nodiscard]] static std::unique_ptr<writer> open(const std::filesystem::path &path) {
+        std::error_code error;
+        const auto existing = std::filesystem::exists(path, error) ? std::filesystem::file_size(path, error) : 0;
+        if (existing != 0) {
+            std::ifstream in(path, std::ios::binary);
+            std::string header(file_header_size, '\0');
+            in.read(header.data(), static_cast<std::streamsize>(header.size()));
+            if (!in || header != file_header()) {
+                spdlog::default_logger()->error("record: {} is not a version {} game record file", path.string(), record_version);
+                return nullptr;
+            }
+        }
+        auto result = std::unique_ptr<writer>(new writer(path));
+        if (!result->out_) {
+            spdlog::default_logger()->error("record: cannot open {} for writing", path.string());
+            return nullptr;
+        }
+        if (existing == 0) {
+            result->out_ << file_header();
+            result->out_.flush();
+        }
+        return result;
+    }
+
+    bool append(const game_record &game) {
+        const auto bytes = encode(game);
+        out_.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        out_.flush();
+        return static_cast<bool>(out_);
+    }
+
+private:
+    explicit writer(const std::filesystem::path &path) : out_(path, std::ios::binary | std::ios::app) {}
+
+    [[nodiscard]] static std::string file_header() {
+        std::string header(record_magic.begin(), record_magic.end());
+        put<std::uint32_t>(header, record_version);
+        put<std::uint32_t>(header, board_rows);
+        return header;
+    }
+
+    std::ofstream out_;
+};
+
+// Maps a record file read-only; iteration yields views into the mapping and
+// does no parsing beyond reading each record's size and checking its moves.
+class reader {
+public:
+    reader(const reader &) = delete;
+    reader &operator=(const reader &) = delete;
+    ~reader() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<std::byte *>(data_), size_);
+        }
+    }
+
+    // Returns nullptr (and logs the reason) if the file is missing or not a
+    // record file of this version.
+    [[nodiscard]] static std::unique_ptr<reader> open(const std::filesystem::path &path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            spdlog::default_logger()->error("record: cannot open {}", path.string());
+            return nullptr;
+        }
+        struct stat info{};
+        if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < file_header_size) {
+            ::close(fd);
+            spdlog::default_logger()->error("record: {} is too short", path.string());
+            return nullptr;
+        }
+        const auto size = static_cast<std::size_t>(info.st_size);
+        void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            spdlog::default_logger()->error("record: cannot map {}", path.string());
+            return nullptr;
+        }
+        ::madvise(mapped, size, MADV_SEQUENTIAL);
+        auto result = std::unique_ptr<reader>(new reader(static_cast<const std::byte *>(mapped), size));
+        const auto *bytes = result->data_;
+        if (!std::equal(record_magic.begin(), record_magic.end(), reinterpret_cast<const char *>(bytes)) ||
+            get<std::uint32_t>(bytes + 8) != record_version || get<std::uint32_t>(bytes + 12) != board_rows) {
+            spdlog::default_logger()->error("record: {} is not a version {} game record file", path.string(), record_version);
+            return nullptr;
+        }
+        return result;
+    }
+
+    class iterator {
+    public:
+        using value_type = game_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        iterator(const std::byte *position, const std::byte *end) noexcept : position_{position}, end_{end} { load(); }
+
+        [[nodiscard]] const game_view &operator*() const noexcept { return current_; }
+        [[nodiscard]] const game_view *operator->() const noexcept { return &current_; }
+
+        iterator &operator++() noexcept {
+            position_ += current_.byte_size();
+            load();
+            return *this;
+        }
+        iterator operator++(int) noexcept {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        [[nodiscard]] bool operator==(const iterator &other) const noexcept { return position_ == other.position_; }
+
+    private:
+        // A record that does not fit or is malformed ends the sequence; one
+        // that fits but has bad moves is skipped.
+        void load() noexcept {
+            for (;;) {
+                const auto remaining = static_cast<std::size_t>(end_ - position_);
+                if (remaining < record_header_size) {
+                    break;
+                }
+                const auto size = get<std::uint32_t>(position_);
+                current_ = game_view{position_, size};
+                if (size > remaining || !current_.fits()) {
+                    break;
+                }
+                if (current_.consistent()) {
+                    return;
+                }
+                spdlog::default_logger()->warn("record: skipping a game with an invalid move");
+                position_ += size;
+            }
+            position_ = end_;
+        }
+
+        const std::byte *position_ = nullptr;
+        const std::byte *end_ = nullptr;
+        game_view current_;
+    };
+
+    [[nodiscard]] iterator begin() const noexcept { return {data_ + file_header_size, data_ + size_}; }
+    [[nodiscard]] iterator end() const noexcept { return {data_ + size_, data_ + size_}; }
+
+private:
+    reader(const std::byte *data, std::size_t size) noexcept : data_{data}, size_{size} {}
+
+    const std::byte *data_;
+    std::size_t size_;
+};
+
+// One game per line, tab separated: black, white, rules, result, reason,
+// moves. Moves are "h8", or "h8:<ms>:<score>" when stats are recorded.
+[[nodiscard]] std::string to_text(const game_record &game) {
+    std::string line = std::format("{}\t{}\t{}\t{}\t{}\t", game.black, game.white, to_string(game.rules),
+                                   game::to_string(game.verdict.result), game::to_string(game.verdict.reason));
+    for (std::size_t i = 0; i < game.moves.size(); ++i) {
+        line += i == 0 ? "" : " ";
+        line += tool::format_move(game.moves[i]);
+        if (game.has_stats()) {
+            line += std::format(":{}:{}", game.times_ms[i], game.scores[i]);
+        }
+    }
+    return line;
+}
+
+[[nodiscard]] std::optional<game_record> from_text(std::string_view line) {
+    std::vector<std::string_view> fields;
+    for (auto field : line | std::views::split('\t')) {
+        fields.emplace_back(field.begin(), field.end());
+    }
+    if (fields.size() != 6) {
+        return std::nullopt;
+    }
+    const auto result = parse_enum<game::outcome>(fields[3], static_cast<int>(game::outcome::draw));
+    const auto reason = parse_enum<game::end_reason>(fields[4], static_cast<int>(game::end_reason::forfeit));
+    if (!result || !reason || (fields[2] != "renju" && fields[2] != "freestyle")) {
+        return std::nullopt;
+    }
+    game_record game{.black = std::string(fields[0]), .white = std::string(fields[1]),
+                     .rules = fields[2] == "freestyle" ? rule::variant::freestyle : rule::variant::renju,
+                     .verdict = {*result, *reason}};
+    for (auto token : fields[5] | std::views::split(' ')) {
+        const std::string_view text(token.begin(), token.end());
+        if (text.empty()) {
+            continue;
+        }
+        const auto first = text.find(':');
+        const auto move = tool::parse_move(text.substr(0, first));
+        if (!move) {
+            return std::nullopt;
+        }
+        if (first == std::string_view::npos) {
+            game.add_move(*move);
+            continue;
+        }
+        const auto second = text.find(':', first + 1);
+        int time_ms = 0;
+        int score = 0;
+        if (second == std::string_view::npos ||
+            std::from_chars(text.data() + first + 1, text.data() + second, time_ms).ec != std::errc{} ||
+            std::from_chars(text.data() + second + 1, text.data() + text.size(), score).ec != std::errc{}) {
+            return std::nullopt;
+        }
+        game.add_move(*move, time_ms / 1000.0, score);
+    }
+    return game;
+}
+
+// Returns the number of games written.
+std::size_t export_text(const reader &games, std::ostream &out) {
+    std::size_t count = 0;
+    for (const auto &game : games) {
+        out << to_text(game.to_record()) << '\n';
+        ++count;
+    }
+    return count;
+}
+
+// Returns the number of games imported; malformed lines are logged and skipped.
+std::size_t import_text(std::istream &in, writer &out) {
+    std::size_t count = 0;
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        if (line.empty()) {
+            continue;
+        }
+        const auto game = from_text(line);
+        if (!game) {
+            spdlog::default_logger()->warn("record: skipping malformed line {}", number);
+            continue;
+        }
+        out.append(*game);
+        ++count;
+    }
+    return count;
+}
+
+}  // namespace record
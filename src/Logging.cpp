@@ -0,0 +1,95 @@
+module;
+
+#include <spdlog/async.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <spdlog/spdlog.h>
+
+// Call sites in the search hot path below this level are compiled out.
+#ifndef GOMOKU_HOT_LOG_LEVEL
+#ifdef NDEBUG
+#define GOMOKU_HOT_LOG_LEVEL SPDLOG_LEVEL_WARN
+#else
+#define GOMOKU_HOT_LOG_LEVEL SPDLOG_LEVEL_INFO
+#endif
+#endif
+
+export module logging;
+
+import std;
+
+namespace {
+
+constexpr std::size_t async_queue_size = 8192;
+
+std::atomic<int> active_searches{0};
+std::atomic<bool> quiet_while_searching{true};
+
+void init_async_pool() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        spdlog::init_thread_pool(async_queue_size, 1);
+        spdlog::flush_every(std::chrono::seconds(1));
+    });
+}
+
+}  // namespace
+
+export namespace logging {
+
+inline constexpr auto hot_path_level = static_cast<spdlog::level::level_enum>(GOMOKU_HOT_LOG_LEVEL);
+
+// File logger backed by a ring buffer drained on a background thread. When
+// the buffer is full the oldest message is dropped instead of blocking the
+// caller, and the file is flushed periodically rather than per message.
+[[nodiscard]] std::shared_ptr<spdlog::logger> async_file_logger(const std::string &name, const std::string &filename) {
+    if (auto existing = spdlog::get(name)) {
+        return existing;
+    }
+    try {
+        init_async_pool();
+        auto created = spdlog::create_async_nb<spdlog::sinks::basic_file_sink_mt>(name, filename, true);
+        created->set_level(spdlog::level::info);
+        created->flush_on(spdlog::level::err);
+        return created;
+    } catch (const spdlog::spdlog_ex &ex) {
+        spdlog::default_logger()->error("Failed to create {}: {}", name, ex.what());
+        return spdlog::default_logger();
+    }
+}
+
+void set_quiet_while_searching(bool quiet) noexcept {
+    quiet_while_searching.store(quiet, std::memory_order_relaxed);
+}
+
+[[nodiscard]] bool suppressed() noexcept {
+    return quiet_while_searching.load(std::memory_order_relaxed) &&
+           active_searches.load(std::memory_order_relaxed) > 0;
+}
+
+// Marks the engine as searching for the lifetime of the scope.
+class search_scope {
+public:
+    search_scope() noexcept { active_searches.fetch_add(1, std::memory_order_relaxed); }
+    ~search_scope() { active_searches.fetch_sub(1, std::memory_order_relaxed); }
+    search_scope(const search_scope &) = delete;
+    search_scope &operator=(const search_scope &) = delete;
+};
+
+// Logging for hot-path call sites. Levels below hot_path_level vanish at
+// compile time, including the logger lookup; the rest are skipped while a
+// search is running unless quiet mode is off.
+template <spdlog::level::level_enum Level, typename LoggerGetter, typename... Args>
+void hot(LoggerGetter &&get_logger, spdlog::format_string_t<Args...> format, Args &&...args) {
+    if constexpr (Level >= hot_path_level) {
+        if (!suppressed()) {
+            get_logger()->log(Level, format, std::forward<Args>(args)...);
+        }
+    }
+}
+
+// Drains queued messages; call before exit.
+void shutdown() {
+    spdlog::shutdown();
+}
+
+}  // namespace logging
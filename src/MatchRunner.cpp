@@ -0,0 +1,328 @@
+module;
+
+#include <stdexec/execution.hpp>
+#include <exec/static_thread_pool.hpp>
+#include <spdlog/spdlog.h>
+
+export module match_runner;
+
+import std;
+
+import ai;
+import chess_info;
+import game_controller;
+import game_record;
+import nnue;
+import player;
+import point;
+import rule;
+import strings;
+import tool;
+
+export namespace match {
+
+struct engine_config {
+    std::string name = "engine";
+    ai::engine_options options{.depth = 2, .tt_megabytes = 16, .threads = 1};
+};
+
+struct match_options {
+    engine_config first{.name = "first"};
+    engine_config second{.name = "second"};
+    int games = 100;
+    unsigned concurrency = 0;  // 0: one game per hardware thread
+    int opening_plies = 2;     // random stones after the centre move
+    std::uint64_t seed = 1;
+    std::filesystem::path output = "match_results.tsv";
+    std::filesystem::path record;  // binary game records, empty: none
+};
+
+struct game_result {
+    int index = 0;
+    bool first_is_black = true;
+    game::adjudication verdict;
+    std::vector<point> opening;
+    std::vector<game::played_move> moves;
+
+    // +1 first engine won, -1 second engine won, 0 draw.
+    [[nodiscard]] int first_score() const noexcept {
+        if (verdict.result == game::outcome::draw) {
+            return 0;
+        }
+        const bool black_won = verdict.result == game::outcome::black_wins;
+        return black_won == first_is_black ? 1 : -1;
+    }
+};
+
+struct match_summary {
+    int first_wins = 0;
+    int second_wins = 0;
+    int draws = 0;
+    double seconds = 0.0;
+};
+
+// Parses "name=a,depth=3,time=500,tt=16,threads=1,solver=20000,evalcache=4,nnue=path|off";
+// time is milliseconds per move, solver the proof-number budget (0: off),
+// evalcache the evaluation cache in megabytes (0: off).
+[[nodiscard]] std::optional<engine_config> parse_engine_config(std::string_view spec, engine_config config = {}) {
+    for (auto part : spec | std::views::split(',')) {
+        const std::string_view item(part.begin(), part.end());
+        const auto eq = item.find('=');
+        if (eq == std::string_view::npos) {
+            return std::nullopt;
+        }
+        const auto key = item.substr(0, eq);
+        const auto value = item.substr(eq + 1);
+        int number = 0;
+        const bool numeric = std::from_chars(value.data(), value.data() + value.size(), number).ec == std::errc{};
+        if (key == "name") {
+            config.name = std::string(value);
+        } else if (key == "depth" && numeric) {
+            config.options.depth = number;
+        } else if (key == "time" && numeric) {
+            config.options.move_time = std::chrono::milliseconds{number};
+        } else if (key == "tt" && numeric) {
+            config.options.tt_megabytes = static_cast<std::size_t>(number);
+        } else if (key == "threads" && numeric) {
+            config.options.threads = static_cast<unsigned>(number);
+        } else if (key == "solver" && numeric) {
+            config.options.solver_nodes = static_cast<std::uint64_t>(number);
+        } else if (key == "evalcache" && numeric) {
+            config.options.eval_cache_megabytes = static_cast<std::size_t>(number);
+        } else if (key == "nnue") {
+            if (value == "off") {
+                config.options.use_network = false;
+            } else if (auto network = nnue::network::load(std::filesystem::path{std::string(value)})) {
+                config.options.network = std::move(network);
+            } else {
+                return std::nullopt;
+            }
+        } else {
+            return std::nullopt;
+        }
+    }
+    return config;
+}
+
+// Centre stone followed by `plies` random stones near the existing ones,
+// skipping any that would end the game. Deterministic for a given seed.
+[[nodiscard]] std::vector<point> random_opening(std::uint64_t seed, int plies) {
+    std::mt19937_64 rng(seed);
+    chess_info state;
+    std::vector<point> opening{point{8, 8}};
+    state.pieces[8][8] = black_piece;
+
+    for (int ply = 1; ply <= plies; ++ply) {
+        const int piece = ply % 2 == 0 ? black_piece : white_piece;
+        std::vector<point> candidates;
+        for (int x : std::views::iota(1, board_rows + 1)) {
+            for (int y : std::views::iota(1, board_cols + 1)) {
+                if (state.pieces[x][y] != 0) continue;
+                bool near = false;
+                for (const auto &stone : opening) {
+                    near = near || (std::abs(stone.x - x) <= 2 && std::abs(stone.y - y) <= 2);
+                }
+                if (!near) continue;
+                state.pieces[x][y] = piece;
+                if (game::adjudicate(state, point{x, y}, piece, ply + 1).result == game::outcome::ongoing) {
+                    candidates.push_back(point{x, y});
+                }
+                state.pieces[x][y] = 0;
+            }
+        }
+        if (candidates.empty()) {
+            break;
+        }
+        const point chosen = candidates[std::uniform_int_distribution<std::size_t>(0, candidates.size() - 1)(rng)];
+        state.pieces[chosen.x][chosen.y] = piece;
+        opening.push_back(chosen);
+    }
+    return opening;
+}
+
+// Plays one game with no terminal I/O, using the interactive game's move
+// validation and adjudication. A missing or illegal move forfeits.
+[[nodiscard]] game_result play_game(int index, const engine_config &black_config, const engine_config &white_config,
+                                    const std::vector<point> &opening) {
+    player::ai_player black(player::piece_side::black, black_config.name, black_config.options);
+    player::ai_player white(player::piece_side::white, white_config.name, white_config.options);
+
+    game_result result;
+    result.index = index;
+    result.opening = opening;
+
+    chess_info state;
+    int move_count = 0;
+    for (const point move : opening) {
+        state.pieces[move.x][move.y] = state.turn == black_turn ? black_piece : white_piece;
+        state.current_point = move;
+        state.turn ^= 1;
+        state.round += 1;
+        ++move_count;
+    }
+
+    while (true) {
+        auto &current = state.turn == black_turn ? static_cast<player::player_base &>(black) : white;
+        const int piece = current.piece_value();
+        const auto forfeit = game::adjudication{
+            piece == black_piece ? game::outcome::white_wins : game::outcome::black_wins, game::end_reason::forfeit};
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto move = current.next_move(state);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (!move.has_value() || game::validate_move(state, *move, piece, true, move_count) != game::move_error::none) {
+            result.verdict = forfeit;
+            return result;
+        }
+
+        state.pieces[move->x][move->y] = piece;
+        state.current_point = *move;
+        ++move_count;
+        result.moves.push_back(game::played_move{*move, seconds, current.last_score()});
+
+        result.verdict = game::adjudicate(state, *move, piece, move_count);
+        if (result.verdict.result != game::outcome::ongoing) {
+            return result;
+        }
+        state.turn ^= 1;
+        state.round += 1;
+    }
+}
+
+// Tab separated: index, black, white, result, reason, plies, opening, moves
+// with the engine's thinking time in seconds (e.g. "h9:0.0123").
+void write_result(std::ostream &out, const game_result &result, const match_options &options) {
+    const auto &black = result.first_is_black ? options.first : options.second;
+    const auto &white = result.first_is_black ? options.second : options.first;
+    out << result.index << '\t' << black.name << '\t' << white.name << '\t' << game::to_string(result.verdict.result)
+        << '\t' << game::to_string(result.verdict.reason) << '\t' << result.opening.size() + result.moves.size() << '\t';
+    for (std::size_t i = 0; i < result.opening.size(); ++i) {
+        out << (i == 0 ? "" : " ") << tool::format_move(result.opening[i]);
+    }
+    out << '\t';
+    for (std::size_t i = 0; i < result.moves.size(); ++i) {
+        out << (i == 0 ? "" : " ") << std::format("{}:{:.4f}", tool::format_move(result.moves[i].move), result.moves[i].seconds);
+    }
+    out << '\n';
+}
+
+// Opening stones carry no time or score.
+[[nodiscard]] record::game_record to_record(const game_result &result, const match_options &options) {
+    const auto &black = result.first_is_black ? options.first : options.second;
+    const auto &white = result.first_is_black ? options.second : options.first;
+    record::game_record game{.black = black.name, .white = white.name, .rules = black.options.rules,
+                             .verdict = result.verdict};
+    for (const point move : result.opening) {
+        game.add_move(move, 0.0, 0);
+    }
+    for (const auto &played : result.moves) {
+        game.add_move(played.move, played.seconds, played.score.value_or(0));
+    }
+    return game;
+}
+
+// Game 2k and 2k+1 share an opening with colours swapped. Games run in
+// parallel; each owns its two engines and therefore their TT budgets.
+// `on_result` is called under a lock as each game finishes and may return
+// false to stop scheduling further games. Returns nothing, before playing
+// any game, when the results or records file cannot be opened.
+std::optional<match_summary> run_match(const match_options &options,
+                                       const std::function<bool(const game_result &, const match_summary &)> &on_result = {}) {
+    std::ofstream out(options.output, std::ios::app);
+    if (!out) {
+        spdlog::default_logger()->error("match: cannot open {}", options.output.string());
+        return std::nullopt;
+    }
+    auto records = options.record.empty() ? nullptr : record::writer::open(options.record);
+    if (!options.record.empty() && !records) {
+        return std::nullopt;  // the writer logged why
+    }
+    std::mutex result_mutex;
+    match_summary summary;
+    std::atomic<bool> stop{false};
+
+    const unsigned concurrency = options.concurrency != 0 ? options.concurrency
+                                                          : std::max(1u, std::thread::hardware_concurrency());
+    exec::static_thread_pool pool(concurrency);
+    const auto start = std::chrono::steady_clock::now();
+
+    auto bulk_sender = stdexec::just()
+        | stdexec::continues_on(pool.get_scheduler())
+        | stdexec::bulk(static_cast<std::size_t>(std::max(options.games, 0)), [&](std::size_t i) {
+            if (stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            const int index = static_cast<int>(i);
+            const bool first_is_black = index % 2 == 0;
+            const auto opening = random_opening(options.seed + static_cast<std::uint64_t>(index / 2), options.opening_plies);
+            auto result = play_game(index,
+                                    first_is_black ? options.first : options.second,
+                                    first_is_black ? options.second : options.first,
+                                    opening);
+            result.first_is_black = first_is_black;
+
+            std::lock_guard lock(result_mutex);
+            switch (result.first_score()) {
+                case 1: ++summary.first_wins; break;
+                case -1: ++summary.second_wins; break;
+                default: ++summary.draws; break;
+            }
+            write_result(out, result, options);
+            out.flush();
+            if (records) {
+                records->append(to_record(result, options));
+            }
+            if (on_result && !on_result(result, summary)) {
+                stop.store(true, std::memory_order_relaxed);
+            }
+        });
+
+    stdexec::sync_wait(std::move(bulk_sender));
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
+
+// Reads --games, --concurrency, --opening-plies, --seed, --out, --record
+// and two --engine specs from the command line.
+[[nodiscard]] std::optional<match_options> parse_options(const std::vector<std::string_view> &args) {
+    match_options options;
+    int engines_seen = 0;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const auto flag = args[i];
+        if (flag == "--match") {
+            continue;
+        }
+        if (i + 1 >= args.size()) {
+            return std::nullopt;
+        }
+        const auto value = args[++i];
+        int number = 0;
+        const bool numeric = std::from_chars(value.data(), value.data() + value.size(), number).ec == std::errc{};
+        if (flag == "--engine" && engines_seen < 2) {
+            auto &target = engines_seen++ == 0 ? options.first : options.second;
+            auto parsed = parse_engine_config(value, target);
+            if (!parsed) {
+                return std::nullopt;
+            }
+            target = std::move(*parsed);
+        } else if (flag == "--games" && numeric) {
+            options.games = number;
+        } else if (flag == "--concurrency" && numeric) {
+            options.concurrency = static_cast<unsigned>(number);
+        } else if (flag == "--opening-plies" && numeric) {
+            options.opening_plies = number;
+        } else if (flag == "--seed" && numeric) {
+            options.seed = static_cast<std::uint64_t>(number);
+        } else if (flag == "--out") {
+            options.output = std::filesystem::path{std::string(value)};
+        } else if (flag == "--record") {
+            options.record = std::filesystem::path{std::string(value)};
+        } else if (flag != "--nnue" && flag != "--trace") {
+            return std::nullopt;
+        }
+    }
+    return options;
+}
+
+}  // namespace match
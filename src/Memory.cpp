@@ -0,0 +1,220 @@
+module;
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+export module memory;
+
+import std;
+
+namespace {
+
+constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+
+// "0-3,8-11" -> {0, 1, 2, 3, 8, 9, 10, 11}
+std::vector<int> parse_cpu_list(std::string_view text) {
+    std::vector<int> cpus;
+    while (!text.empty()) {
+        const auto comma = text.find(',');
+        const auto item = text.substr(0, comma);
+        int first = 0;
+        int last = 0;
+        const auto dash = item.find('-');
+        const auto parsed = std::from_chars(item.data(), item.data() + item.size(), first);
+        if (parsed.ec == std::errc{}) {
+            last = first;
+            if (dash != std::string_view::npos) {
+                std::from_chars(item.data() + dash + 1, item.data() + item.size(), last);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+        }
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+    }
+    return cpus;
+}
+
+// Restricts the calling thread to `cpus`.
+bool set_affinity(const std::vector<int> &cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (const int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+std::atomic<unsigned> next_node{0};
+thread_local int pinned_node = -1;
+
+}  // namespace
+
+export namespace memory {
+
+struct numa_node {
+    int id = 0;
+    std::vector<int> cpus;  // empty: unknown, do not pin
+};
+
+// NUMA nodes from sysfs. Without NUMA information this is one node with
+// no CPU list, and the placement helpers below do nothing.
+[[nodiscard]] const std::vector<numa_node> &numa_nodes() {
+    static const std::vector<numa_node> nodes = [] {
+        std::vector<numa_node> found;
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+            const auto name = entry.path().filename().string();
+            int id = 0;
+            if (!name.starts_with("node") ||
+                std::from_chars(name.data() + 4, name.data() + name.size(), id).ec != std::errc{}) {
+                continue;
+            }
+            std::ifstream in(entry.path() / "cpulist");
+            std::string list;
+            std::getline(in, list);
+            auto cpus = parse_cpu_list(list);
+            if (!cpus.empty()) found.push_back(numa_node{id, std::move(cpus)});
+        }
+        std::ranges::sort(found, {}, &numa_node::id);
+        if (found.empty()) found.push_back(numa_node{});
+        return found;
+    }();
+    return nodes;
+}
+
+// Pins the calling thread to the CPUs of one node, nodes taken round robin
+// across calls; later calls from the same thread keep the first node.
+// Returns the index of the node in numa_nodes().
+int pin_thread_to_node() {
+    if (pinned_node >= 0) return pinned_node;
+    const auto &nodes = numa_nodes();
+    pinned_node = static_cast<int>(next_node.fetch_add(1, std::memory_order_relaxed) % nodes.size());
+    if (nodes.size() > 1 && !set_affinity(nodes[pinned_node].cpus)) {
+        spdlog::default_logger()->warn("memory: cannot pin thread to node {}", nodes[pinned_node].id);
+    }
+    return pinned_node;
+}
+
+// Where the pages of a buffer go on a multi-node host.
+enum class placement {
+    interleave,  // page by page across all nodes
+    partition,   // one contiguous block per node, first touched there
+};
+
+// Anonymous, zero-filled memory for large tables. Sizes of a huge page or
+// more ask for explicit huge pages first, then transparent huge pages,
+// then fall back to normal pages; smaller ones use normal pages.
+class large_buffer {
+public:
+    large_buffer() = default;
+
+    explicit large_buffer(std::size_t bytes) : size_(bytes) {
+        if (bytes == 0) return;
+#ifdef __linux__
+        if (bytes >= huge_page_size) {
+            const std::size_t rounded = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+            void *p = ::mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                data_ = p;
+                mapped_ = rounded;
+                huge_ = true;
+                return;
+            }
+        }
+        void *p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        data_ = p;
+        mapped_ = bytes;
+        if (bytes >= huge_page_size) huge_ = ::madvise(p, bytes, MADV_HUGEPAGE) == 0;
+#else
+        data_ = ::operator new(bytes, std::align_val_t{4096});
+        std::memset(data_, 0, bytes);
+#endif
+    }
+
+    large_buffer(large_buffer &&other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+          mapped_(std::exchange(other.mapped_, 0)), huge_(other.huge_) {}
+
+    large_buffer &operator=(large_buffer &&other) noexcept {
+        if (this != &other) {
+            release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            mapped_ = std::exchange(other.mapped_, 0);
+            huge_ = other.huge_;
+        }
+        return *this;
+    }
+
+    ~large_buffer() { release(); }
+
+    [[nodiscard]] void *data() const noexcept { return data_; }
+    [[nodiscard]] std::size_t size() const noexcept { return size_; }
+    // Backed by explicit huge pages, or advised to use transparent ones.
+    [[nodiscard]] bool huge() const noexcept { return huge_; }
+
+    // Spreads the pages over the NUMA nodes and touches them, so they are
+    // placed before the first search rather than wherever it faults them.
+    // Call before the memory is used; a single-node host only touches.
+    void place(placement where) {
+        const auto &nodes = numa_nodes();
+        if (!data_ || size_ == 0) return;
+        const std::size_t count = nodes.size();
+        auto *bytes = static_cast<std::byte *>(data_);
+#ifdef __linux__
+        if (count > 1 && where == placement::interleave) {
+            unsigned long mask = 0;
+            for (const auto &node : nodes) {
+                if (node.id < static_cast<int>(8 * sizeof(mask))) mask |= 1UL << node.id;
+            }
+            if (::syscall(SYS_mbind, data_, mapped_, MPOL_INTERLEAVE, &mask, 8 * sizeof(mask), 0) != 0) {
+                spdlog::default_logger()->warn("memory: cannot interleave {} bytes", size_);
+            }
+        }
+#endif
+        // One toucher per node, pinned there: under `partition` each block
+        // is first touched, and so allocated, on its own node.
+        const std::size_t page = huge_ ? huge_page_size : 4096;
+        const std::size_t block = (size_ / count + page - 1) / page * page;
+        std::vector<std::jthread> touchers;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::size_t begin = std::min(size_, i * block);
+            const std::size_t end = std::min(size_, begin + block);
+            touchers.emplace_back([=, &nodes] {
+                if (count > 1 && where == placement::partition) set_affinity(nodes[i].cpus);
+                for (std::size_t offset = begin; offset < end; offset += 4096) {
+                    bytes[offset] = std::byte{0};
+                }
+            });
+        }
+    }
+
+private:
+    void release() noexcept {
+        if (!data_) return;
+#ifdef __linux__
+        ::munmap(data_, mapped_);
+#else
+        ::operator delete(data_, std::align_val_t{4096});
+#endif
+        data_ = nullptr;
+    }
+
+    void *data_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t mapped_ = 0;
+    bool huge_ = false;
+};
+
+}  // namespace memory
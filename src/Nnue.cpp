@@ -0,0 +1,264 @@
+module;
+
+#include <spdlog/spdlog.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+export module nnue;
+
+import std;
+
+import point;
+import strings;
+import tool;
+
+// Weight file layout (little endian):
+//   char     magic[8]        "GMKNNUE\0"
+//   uint32   version         file_version
+//   uint32   feature_count   2 * board_rows * board_cols
+//   uint32   hidden_size
+//   uint32   output_hidden
+//   int32    output_scale    final score = output * output_scale / 1024
+//   int16    l1_bias[hidden_size]
+//   int16    l1_weights[feature_count][hidden_size]
+//   int32    l2_bias[output_hidden]
+//   int8     l2_weights[output_hidden][hidden_size]
+//   int32    l3_bias
+//   int8     l3_weights[output_hidden]
+//
+// Feature (piece, x, y) is one-hot; only the stone that is placed or removed
+// touches the first layer, so the accumulator is updated by a single row.
+
+namespace {
+
+constexpr std::array<char, 8> file_magic{ 'G', 'M', 'K', 'N', 'N', 'U', 'E', '\0' };
+constexpr int l2_shift = 6;
+constexpr int activation_max = 127;
+
+template <typename T>
+bool read_array(std::istream &in, T *data, std::size_t count) {
+    in.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(count * sizeof(T)));
+    return static_cast<bool>(in);
+}
+
+}  // namespace
+
+export namespace nnue {
+
+inline constexpr std::uint32_t file_version = 1;
+inline constexpr int feature_count = 2 * board_rows * board_cols;
+inline constexpr int hidden_size = 128;
+inline constexpr int output_hidden = 32;
+
+struct alignas(64) accumulator {
+    std::array<std::int16_t, hidden_size> values{};
+};
+
+[[nodiscard]] constexpr int feature_index(point p, int piece) noexcept {
+    return ((piece - 1) * board_rows + (p.x - 1)) * board_cols + (p.y - 1);
+}
+
+class network {
+public:
+    // Returns nullptr (and logs the reason) if the file is missing or does
+    // not match the dimensions this binary was built with.
+    [[nodiscard]] static std::shared_ptr<const network> load(const std::filesystem::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            spdlog::default_logger()->error("nnue: cannot open weights file {}", path.string());
+            return nullptr;
+        }
+
+        std::array<char, 8> magic{};
+        std::uint32_t version = 0;
+        std::uint32_t features = 0;
+        std::uint32_t hidden = 0;
+        std::uint32_t out_hidden = 0;
+        auto net = std::make_shared<network>();
+        if (!read_array(in, magic.data(), magic.size()) || !read_array(in, &version, 1) ||
+            !read_array(in, &features, 1) || !read_array(in, &hidden, 1) ||
+            !read_array(in, &out_hidden, 1) || !read_array(in, &net->output_scale_, 1)) {
+            spdlog::default_logger()->error("nnue: truncated header in {}", path.string());
+            return nullptr;
+        }
+        if (magic != file_magic || version != file_version || features != feature_count ||
+            hidden != hidden_size || out_hidden != output_hidden) {
+            spdlog::default_logger()->error("nnue: incompatible weights file {} (version {}, {}x{}x{})",
+                                            path.string(), version, features, hidden, out_hidden);
+            return nullptr;
+        }
+        if (!read_array(in, net->l1_bias_.values.data(), hidden_size) ||
+            !read_array(in, net->l1_weights_.data()->values.data(), std::size_t{feature_count} * hidden_size) ||
+            !read_array(in, net->l2_bias_.data(), output_hidden) ||
+            !read_array(in, net->l2_weights_.data()->data(), std::size_t{output_hidden} * hidden_size) ||
+            !read_array(in, &net->l3_bias_, 1) ||
+            !read_array(in, net->l3_weights_.data(), output_hidden)) {
+            spdlog::default_logger()->error("nnue: truncated weights in {}", path.string());
+            return nullptr;
+        }
+        std::uint64_t hash = tool::fnv1a(std::as_bytes(std::span(&net->l1_bias_, 1)));
+        hash = tool::fnv1a(std::as_bytes(std::span(net->l1_weights_)), hash);
+        hash = tool::fnv1a(std::as_bytes(std::span(net->l2_bias_)), hash);
+        hash = tool::fnv1a(std::as_bytes(std::span(net->l2_weights_)), hash);
+        hash = tool::fnv1a(std::as_bytes(std::span(&net->l3_bias_, 1)), hash);
+        hash = tool::fnv1a(std::as_bytes(std::span(net->l3_weights_)), hash);
+        net->fingerprint_ = tool::fnv1a(std::as_bytes(std::span(&net->output_scale_, 1)), hash);
+        return net;
+    }
+
+    void refresh(accumulator &acc, const int (&board)[16][16]) const noexcept {
+        acc = l1_bias_;
+        for (int x : std::views::iota(1, board_rows + 1)) {
+            for (int y : std::views::iota(1, board_cols + 1)) {
+                if (board[x][y] != 0) {
+                    add_stone(acc, point{x, y}, board[x][y]);
+                }
+            }
+        }
+    }
+
+    void add_stone(accumulator &acc, point p, int piece) const noexcept {
+        add_row(acc, l1_weights_[feature_index(p, piece)]);
+    }
+
+    void remove_stone(accumulator &acc, point p, int piece) const noexcept {
+        sub_row(acc, l1_weights_[feature_index(p, piece)]);
+    }
+
+    // Hash of the weights; identifies the evaluator in TT snapshots.
+    [[nodiscard]] std::uint64_t fingerprint() const noexcept { return fingerprint_; }
+
+    // Score from black's point of view, on the same scale as the pattern evaluator.
+    [[nodiscard]] int evaluate(const accumulator &acc) const noexcept {
+        alignas(64) std::array<std::uint8_t, hidden_size> hidden{};
+        clipped_relu(acc, hidden);
+
+        alignas(64) std::array<std::int8_t, output_hidden> second{};
+        for (int i : std::views::iota(0, output_hidden)) {
+            const int sum = l2_bias_[i] + dot(hidden, l2_weights_[i]);
+            second[i] = static_cast<std::int8_t>(std::clamp(sum >> l2_shift, 0, activation_max));
+        }
+
+        int output = l3_bias_;
+        for (int i : std::views::iota(0, output_hidden)) {
+            output += second[i] * l3_weights_[i];
+        }
+        return static_cast<int>(static_cast<std::int64_t>(output) * output_scale_ / 1024);
+    }
+
+private:
+    static void add_row(accumulator &acc, const accumulator &row) noexcept {
+#if defined(__AVX2__)
+        for (int i = 0; i < hidden_size; i += 16) {
+            auto *dst = reinterpret_cast<__m256i *>(acc.values.data() + i);
+            const auto *src = reinterpret_cast<const __m256i *>(row.values.data() + i);
+            _mm256_store_si256(dst, _mm256_add_epi16(_mm256_load_si256(dst), _mm256_load_si256(src)));
+        }
+#elif defined(__SSE2__)
+        for (int i = 0; i < hidden_size; i += 8) {
+            auto *dst = reinterpret_cast<__m128i *>(acc.values.data() + i);
+            const auto *src = reinterpret_cast<const __m128i *>(row.values.data() + i);
+            _mm_store_si128(dst, _mm_add_epi16(_mm_load_si128(dst), _mm_load_si128(src)));
+        }
+#else
+        for (int i : std::views::iota(0, hidden_size)) {
+            acc.values[i] = static_cast<std::int16_t>(acc.values[i] + row.values[i]);
+        }
+#endif
+    }
+
+    static void sub_row(accumulator &acc, const accumulator &row) noexcept {
+#if defined(__AVX2__)
+        for (int i = 0; i < hidden_size; i += 16) {
+            auto *dst = reinterpret_cast<__m256i *>(acc.values.data() + i);
+            const auto *src = reinterpret_cast<const __m256i *>(row.values.data() + i);
+            _mm256_store_si256(dst, _mm256_sub_epi16(_mm256_load_si256(dst), _mm256_load_si256(src)));
+        }
+#elif defined(__SSE2__)
+        for (int i = 0; i < hidden_size; i += 8) {
+            auto *dst = reinterpret_cast<__m128i *>(acc.values.data() + i);
+            const auto *src = reinterpret_cast<const __m128i *>(row.values.data() + i);
+            _mm_store_si128(dst, _mm_sub_epi16(_mm_load_si128(dst), _mm_load_si128(src)));
+        }
+#else
+        for (int i : std::views::iota(0, hidden_size)) {
+            acc.values[i] = static_cast<std::int16_t>(acc.values[i] - row.values[i]);
+        }
+#endif
+    }
+
+    static void clipped_relu(const accumulator &acc, std::array<std::uint8_t, hidden_size> &out) noexcept {
+#if defined(__AVX2__)
+        const __m256i zero = _mm256_setzero_si256();
+        for (int i = 0; i < hidden_size; i += 32) {
+            const __m256i lo = _mm256_load_si256(reinterpret_cast<const __m256i *>(acc.values.data() + i));
+            const __m256i hi = _mm256_load_si256(reinterpret_cast<const __m256i *>(acc.values.data() + i + 16));
+            // packs saturates to [-128, 127]; max with zero gives [0, 127].
+            // The 128-bit lanes come out interleaved, so restore order with a permute.
+            const __m256i packed = _mm256_max_epi8(_mm256_packs_epi16(lo, hi), zero);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(out.data() + i),
+                               _mm256_permute4x64_epi64(packed, 0b11'01'10'00));
+        }
+#elif defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < hidden_size; i += 16) {
+            const __m128i lo = _mm_max_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(acc.values.data() + i)), zero);
+            const __m128i hi = _mm_max_epi16(_mm_load_si128(reinterpret_cast<const __m128i *>(acc.values.data() + i + 8)), zero);
+            _mm_store_si128(reinterpret_cast<__m128i *>(out.data() + i), _mm_packs_epi16(lo, hi));
+        }
+#else
+        for (int i : std::views::iota(0, hidden_size)) {
+            out[i] = static_cast<std::uint8_t>(std::clamp<int>(acc.values[i], 0, activation_max));
+        }
+#endif
+    }
+
+    static int dot(const std::array<std::uint8_t, hidden_size> &input,
+                   const std::array<std::int8_t, hidden_size> &weights) noexcept {
+#if defined(__AVX2__)
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < hidden_size; i += 32) {
+            const __m256i in = _mm256_load_si256(reinterpret_cast<const __m256i *>(input.data() + i));
+            const __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i *>(weights.data() + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(in, w), ones));
+        }
+        const __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        const __m128i quarter = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0b01'00'11'10));
+        return _mm_cvtsi128_si32(_mm_add_epi32(quarter, _mm_shuffle_epi32(quarter, 0b10'11'00'01)));
+#elif defined(__SSSE3__)
+        const __m128i ones = _mm_set1_epi16(1);
+        __m128i sum = _mm_setzero_si128();
+        for (int i = 0; i < hidden_size; i += 16) {
+            const __m128i in = _mm_load_si128(reinterpret_cast<const __m128i *>(input.data() + i));
+            const __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(weights.data() + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(in, w), ones));
+        }
+        const __m128i half = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01'00'11'10));
+        return _mm_cvtsi128_si32(_mm_add_epi32(half, _mm_shuffle_epi32(half, 0b10'11'00'01)));
+#else
+        int sum = 0;
+        for (int i : std::views::iota(0, hidden_size)) {
+            sum += static_cast<int>(input[i]) * static_cast<int>(weights[i]);
+        }
+        return sum;
+#endif
+    }
+
+    accumulator l1_bias_{};
+    std::array<accumulator, feature_count> l1_weights_{};
+    std::array<std::int32_t, output_hidden> l2_bias_{};
+    alignas(64) std::array<std::array<std::int8_t, hidden_size>, output_hidden> l2_weights_{};
+    std::int32_t l3_bias_{0};
+    std::array<std::int8_t, output_hidden> l3_weights_{};
+    std::int32_t output_scale_{1024};
+    std::uint64_t fingerprint_{0};
+};
+
+}  // namespace nnue
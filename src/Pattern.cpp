@@ -8,3 +8,27 @@ export struct pattern_entry {
     std::string_view s;
     int score;
 };
+
+// A pattern_entry decoded for matching against board cells: the digits of
+// the pattern become piece values (0 empty, 1 black, 2 white).
+export struct compiled_pattern {
+    std::array<std::uint8_t, 6> cells{};
+    int length{0};
+    int score{0};
+};
+
+export template <std::size_t N>
+[[nodiscard]] consteval std::array<compiled_pattern, N> compile_patterns(const std::array<pattern_entry, N> &table) {
+    std::array<compiled_pattern, N> compiled{};
+    for (std::size_t i = 0; i < N; ++i) {
+        const auto &[text, score] = table[i];
+        if (text.size() > compiled[i].cells.size()) throw "pattern too long";
+        for (std::size_t k = 0; k < text.size(); ++k) {
+            if (text[k] < '0' || text[k] > '2') throw "pattern cells are 0, 1 or 2";
+            compiled[i].cells[k] = static_cast<std::uint8_t>(text[k] - '0');
+        }
+        compiled[i].length = static_cast<int>(text.size());
+        compiled[i].score = score;
+    }
+    return compiled;
+}
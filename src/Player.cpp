@@ -32,6 +32,9 @@ public:
 
     [[nodiscard]] virtual std::optional<point> next_move(const chess_info &state) = 0;
 
+    // Score behind the last move returned, from this player's point of view.
+    [[nodiscard]] virtual std::optional<int> last_score() const { return std::nullopt; }
+
 protected:
     piece_side side_;
     int piece_;
@@ -76,6 +79,9 @@ public:
     ai_player(piece_side side, std::string label, int depth)
         : player_base(side, false, std::move(label)), engine_(depth) {}
 
+    ai_player(piece_side side, std::string label, const ai::engine_options &options)
+        : player_base(side, false, std::move(label)), engine_(options) {}
+
     [[nodiscard]] std::optional<point> next_move(const chess_info &state) override {
         if (state.round == 0) {
             return point{8, 8};
@@ -87,6 +93,8 @@ public:
         return choice;
     }
 
+    [[nodiscard]] std::optional<int> last_score() const override { return engine_.last_search().score; }
+
 private:
     ai::engine engine_{};
 };
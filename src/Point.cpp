@@ -23,6 +23,12 @@ export struct point {
         return x >= 1 && x <= board_rows && y >= 1 && y <= board_cols;
     }
 
+    // Same as is_valid() on a Size x Size board.
+    template <int Size>
+    [[nodiscard]] constexpr bool is_on_board() const noexcept {
+        return x >= 1 && x <= Size && y >= 1 && y <= Size;
+    }
+
     [[nodiscard]] constexpr bool is_empty(const int (&piece)[16][16]) const noexcept {
         return piece[x][y] == 0;
     }
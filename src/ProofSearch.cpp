@@ -0,0 +1,380 @@
+module;
+
+export module proof_search;
+
+import std;
+
+import chess_info;
+import point;
+import rule;
+import strings;
+import tool;
+
+// Depth-first proof-number search (df-pn) over victory-by-continuous-fours
+// trees. The attacker only plays moves that make a four; the defender's
+// only moves are the points that stop the five, unless the defender can
+// make five first. Both restrictions are sound, so a proof is a real forced
+// win, while a disproof only means no win by fours exists.
+//
+// Positions only ever gain stones, so the search graph has no cycles and
+// the proof and disproof numbers in the table need no history handling.
+
+// Not exported, but outside an anonymous namespace: the solver template is
+// instantiated in importing units and refers to these.
+namespace pns {
+
+constexpr std::uint32_t proof_infinity = std::numeric_limits<std::uint32_t>::max() / 2;
+
+[[nodiscard]] constexpr std::uint32_t saturating_add(std::uint32_t a, std::uint32_t b) noexcept {
+    return std::min(a + b, proof_infinity);  // both operands are at most proof_infinity
+}
+
+template <int Size>
+struct solver_keys {
+    std::array<std::array<std::array<std::uint64_t, 2>, Size + 1>, Size + 1> stones{};
+    std::array<std::uint64_t, 2> attacker{};
+    std::uint64_t freestyle{0};
+};
+
+template <int Size>
+consteval solver_keys<Size> make_keys() {
+    solver_keys<Size> k;
+    std::uint64_t state = 0x70726f6f66ULL;
+    for (auto &column : k.stones) {
+        for (auto &cell : column) {
+            cell[0] = tool::splitmix64(state);
+            cell[1] = tool::splitmix64(state);
+        }
+    }
+    k.attacker[0] = tool::splitmix64(state);
+    k.attacker[1] = tool::splitmix64(state);
+    k.freestyle = tool::splitmix64(state);
+    return k;
+}
+
+template <int Size>
+inline constexpr solver_keys<Size> keys = make_keys<Size>();
+
+}  // namespace pns
+
+export namespace pns {
+
+enum class verdict { unknown, win, loss };
+
+struct result {
+    verdict outcome = verdict::unknown;  // for the side to move
+    point move{-1, -1};                  // the winning move, or the forced reply of a lost position
+    std::uint64_t nodes = 0;
+};
+
+// Proof and disproof numbers by position; separate from the engine's TT
+// because the numbers mean nothing to alpha-beta. Buckets of four 16-byte
+// slots; a store replaces the matching key, else the slot with the least
+// settled numbers. Proven and disproven positions are kept over open ones.
+class table {
+    struct slot {
+        std::uint64_t key{0};
+        std::uint32_t pn{0};
+        std::uint32_t dn{0};
+    };
+    static_assert(sizeof(slot) == 16);
+
+    static constexpr std::size_t bucket_slots = 4;
+    struct alignas(64) bucket {
+        std::array<slot, bucket_slots> slots{};
+    };
+
+public:
+    explicit table(std::size_t megabytes) {
+        const std::size_t bytes = std::max<std::size_t>(megabytes, 1) * 1024 * 1024;
+        buckets_.assign(std::bit_floor(bytes / sizeof(bucket)), bucket{});
+        mask_ = buckets_.size() - 1;
+    }
+
+    [[nodiscard]] std::optional<std::pair<std::uint32_t, std::uint32_t>> find(std::uint64_t key) const noexcept {
+        for (const auto &s : buckets_[key & mask_].slots) {
+            if (s.key == key) return std::pair{s.pn, s.dn};
+        }
+        return std::nullopt;
+    }
+
+    void store(std::uint64_t key, std::uint32_t pn, std::uint32_t dn) noexcept {
+        auto &slots = buckets_[key & mask_].slots;
+        const auto weight = [](const slot &s) {
+            return s.key == 0 ? 0 : s.pn == 0 || s.dn == 0 ? proof_infinity : saturating_add(s.pn, s.dn);
+        };
+        slot *target = &slots[0];
+        for (auto &s : slots) {
+            if (s.key == key) {
+                target = &s;
+                break;
+            }
+            if (weight(s) < weight(*target)) {
+                target = &s;
+            }
+        }
+        *target = slot{key, pn, dn};
+    }
+
+private:
+    std::vector<bucket> buckets_;
+    std::size_t mask_{0};
+};
+
+template <int Size>
+    requires board_size<Size>
+class basic_solver {
+public:
+    explicit basic_solver(std::size_t megabytes) : table_(megabytes) {}
+
+    // Tries, within `node_limit` expanded nodes and before `deadline`, to
+    // prove that the side to move wins by fours, or else that it is facing
+    // a four it cannot stop without losing to the opponent's fours.
+    template <typename Rules>
+    [[nodiscard]] result solve(const basic_chess_info<Size> &state, std::uint64_t node_limit,
+                               std::optional<std::chrono::steady_clock::time_point> deadline = std::nullopt) {
+        std::copy(&state.pieces[0][0], &state.pieces[0][0] + (Size + 1) * (Size + 1), &board_[0][0]);
+        runs_.reset(board_);
+        nodes_ = 0;
+        node_limit_ = node_limit;
+        deadline_ = deadline;
+        timed_out_ = false;
+        next_clock_check_ = 0;
+        const int mover = state.turn == black_turn ? black_piece : white_piece;
+        const int opponent = mover == black_piece ? white_piece : black_piece;
+        std::uint64_t stones = std::is_same_v<Rules, rule::freestyle_rules> ? keys<Size>.freestyle : 0;
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                if (board_[x][y] != 0) stones ^= keys<Size>.stones[x][y][board_[x][y] - 1];
+            }
+        }
+
+        result outcome;
+        if (prove<Rules>(stones, mover, true)) {
+            // A proven root whose winning child has since been replaced in
+            // the table proves nothing about any particular move.
+            if (const point move = proven_child<Rules>(true); move.is_on_board<Size>()) {
+                outcome = result{verdict::win, move, 0};
+            }
+        } else if (!five_points<Rules>(opponent).empty() && prove<Rules>(stones, opponent, false)) {
+            outcome = result{verdict::loss, proven_child<Rules>(false), 0};
+        }
+        outcome.nodes = nodes_;
+        return outcome;
+    }
+
+private:
+    using bounds = std::pair<std::uint32_t, std::uint32_t>;  // proof, disproof
+
+    table table_;
+    int board_[Size + 1][Size + 1]{};
+    rule::basic_run_lengths<Size> runs_;
+    std::uint64_t hash_ = 0;
+    int attacker_ = black_piece;
+    std::uint64_t nodes_ = 0;
+    std::uint64_t node_limit_ = 0;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    bool timed_out_ = false;
+    std::uint64_t next_clock_check_ = 0;
+
+    [[nodiscard]] int defender() const noexcept { return attacker_ == black_piece ? white_piece : black_piece; }
+
+    template <typename Rules>
+    bool prove(std::uint64_t stones, int attacker, bool or_root) {
+        attacker_ = attacker;
+        hash_ = stones ^ keys<Size>.attacker[attacker - 1];
+        mid<Rules>(or_root, bounds{proof_infinity, proof_infinity});
+        const auto root = table_.find(hash_);
+        return root && root->first == 0;
+    }
+
+    // The root child that completes the proof: the attacker's winning move,
+    // or the defender's (lost) reply when the root is the defender's. Off
+    // the board when no attacker's move is still proven in the table.
+    template <typename Rules>
+    [[nodiscard]] point proven_child(bool or_node) {
+        if (const auto fives = five_points<Rules>(attacker_); or_node && !fives.empty()) {
+            return fives.front();
+        }
+        std::vector<point> children;
+        expand<Rules>(or_node, children);
+        const int mover = or_node ? attacker_ : defender();
+        for (const point child : children) {
+            const auto entry = table_.find(hash_ ^ keys<Size>.stones[child.x][child.y][mover - 1]);
+            if (!or_node || (entry && entry->first == 0)) return child;
+        }
+        return point{-1, -1};
+    }
+
+    // The clock is read about every 256 nodes.
+    [[nodiscard]] bool out_of_budget() noexcept {
+        if (deadline_ && !timed_out_ && nodes_ >= next_clock_check_) {
+            next_clock_check_ = nodes_ + 256;
+            timed_out_ = std::chrono::steady_clock::now() >= *deadline_;
+        }
+        return timed_out_ || nodes_ >= node_limit_;
+    }
+
+    void play(point move, int piece) noexcept {
+        board_[move.x][move.y] = piece;
+        runs_.place(board_, move, piece);
+        hash_ ^= keys<Size>.stones[move.x][move.y][piece - 1];
+    }
+
+    void undo(point move, int piece) noexcept {
+        board_[move.x][move.y] = 0;
+        runs_.remove(board_, move, piece);
+        hash_ ^= keys<Size>.stones[move.x][move.y][piece - 1];
+    }
+
+    template <typename Rules>
+    [[nodiscard]] bool makes_five(point p, int piece) const noexcept {
+        return piece == black_piece ? Rules::template wins<black_piece>(runs_, p) : Rules::template wins<white_piece>(runs_, p);
+    }
+
+    // Call with `move` already on the board.
+    template <typename Rules>
+    [[nodiscard]] bool is_forbidden(point move, int piece) const {
+        return piece == black_piece && Rules::template is_forbidden<black_piece>(board_, move);
+    }
+
+    template <typename Rules>
+    [[nodiscard]] std::vector<point> five_points(int piece) const {
+        std::vector<point> points;
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                if (board_[x][y] == 0 && makes_five<Rules>(point{x, y}, piece)) points.push_back(point{x, y});
+            }
+        }
+        return points;
+    }
+
+    // Does `piece`, just placed on `move`, threaten a five on one of its lines?
+    template <typename Rules>
+    [[nodiscard]] bool makes_four(point move, int piece) const noexcept {
+        for (const point delta : {point{1, 0}, point{0, 1}, point{1, 1}, point{1, -1}}) {
+            for (int k = -4; k <= 4; ++k) {
+                const point p{move.x + k * delta.x, move.y + k * delta.y};
+                if (k != 0 && p.is_on_board<Size>() && board_[p.x][p.y] == 0 && makes_five<Rules>(p, piece)) return true;
+            }
+        }
+        return false;
+    }
+
+    // A four needs three more of the mover's stones within four cells on one line.
+    [[nodiscard]] bool could_make_four(point p, int piece) const noexcept {
+        for (const point delta : {point{1, 0}, point{0, 1}, point{1, 1}, point{1, -1}}) {
+            int stones = 0;
+            for (int k = -4; k <= 4; ++k) {
+                const point q{p.x + k * delta.x, p.y + k * delta.y};
+                stones += k != 0 && q.is_on_board<Size>() && board_[q.x][q.y] == piece;
+            }
+            if (stones >= 3) return true;
+        }
+        return false;
+    }
+
+    // Children of the node to move, or its proof and disproof numbers when
+    // it is decided without searching.
+    template <typename Rules>
+    std::optional<bounds> expand(bool or_node, std::vector<point> &children) {
+        constexpr bounds proven{0, proof_infinity};
+        constexpr bounds disproven{proof_infinity, 0};
+        const int attacker = attacker_;
+        const int defender = this->defender();
+
+        if (or_node) {
+            if (!five_points<Rules>(attacker).empty()) return proven;
+            const auto threats = five_points<Rules>(defender);
+            if (threats.size() > 1) return disproven;
+            for (int x = 1; x <= Size; ++x) {
+                for (int y = 1; y <= Size; ++y) {
+                    const point p{x, y};
+                    if (board_[x][y] != 0 || !could_make_four(p, attacker)) continue;
+                    if (threats.size() == 1 && (threats[0].x != x || threats[0].y != y)) continue;
+                    play(p, attacker);
+                    if (makes_four<Rules>(p, attacker) && !is_forbidden<Rules>(p, attacker)) children.push_back(p);
+                    undo(p, attacker);
+                }
+            }
+            return children.empty() ? std::optional{disproven} : std::nullopt;
+        }
+
+        if (!five_points<Rules>(defender).empty()) return disproven;
+        for (const point p : five_points<Rules>(attacker)) {
+            play(p, defender);
+            if (!is_forbidden<Rules>(p, defender)) children.push_back(p);
+            undo(p, defender);
+        }
+        return children.empty() ? std::optional{proven} : std::nullopt;
+    }
+
+    template <typename Rules>
+    void mid(bool or_node, bounds threshold) {
+        ++nodes_;
+        std::vector<point> children;
+        if (const auto decided = expand<Rules>(or_node, children)) {
+            table_.store(hash_, decided->first, decided->second);
+            return;
+        }
+        const int mover = or_node ? attacker_ : defender();
+
+        while (true) {
+            // OR node: proof is the easiest child's, disproof the sum; AND
+            // node the other way round. "Easiest" is the child the node's
+            // side would pick: least proof (OR) or least disproof (AND).
+            bounds current = or_node ? bounds{proof_infinity, 0} : bounds{0, proof_infinity};
+            std::size_t best = 0;
+            std::uint32_t best_value = proof_infinity;
+            std::uint32_t second_value = proof_infinity;
+            bounds best_child{1, 1};
+            for (std::size_t i = 0; i < children.size(); ++i) {
+                const point p = children[i];
+                const bounds child = table_.find(hash_ ^ keys<Size>.stones[p.x][p.y][mover - 1]).value_or(bounds{1, 1});
+                const std::uint32_t value = or_node ? child.first : child.second;
+                if (or_node) {
+                    current = bounds{std::min(current.first, child.first), saturating_add(current.second, child.second)};
+                } else {
+                    current = bounds{saturating_add(current.first, child.first), std::min(current.second, child.second)};
+                }
+                if (value < best_value) {
+                    second_value = best_value;
+                    best_value = value;
+                    best = i;
+                    best_child = child;
+                } else if (value < second_value) {
+                    second_value = value;
+                }
+            }
+
+            if (current.first >= threshold.first || current.second >= threshold.second || out_of_budget()) {
+                table_.store(hash_, current.first, current.second);
+                return;
+            }
+
+            // The chosen child may use its own numbers plus whatever slack
+            // the node's threshold leaves, but must hand over once it is no
+            // longer the easiest child.
+            bounds child_threshold;
+            if (or_node) {
+                child_threshold = bounds{std::min(threshold.first, saturating_add(second_value, 1)),
+                                         threshold.second >= proof_infinity
+                                             ? proof_infinity
+                                             : threshold.second - current.second + best_child.second};
+            } else {
+                child_threshold = bounds{threshold.first >= proof_infinity
+                                             ? proof_infinity
+                                             : threshold.first - current.first + best_child.first,
+                                         std::min(threshold.second, saturating_add(second_value, 1))};
+            }
+            const point move = children[best];
+            play(move, mover);
+            mid<Rules>(!or_node, child_threshold);
+            undo(move, mover);
+        }
+    }
+};
+
+using solver = basic_solver<board_rows>;
+
+}  // namespace pns
@@ -0,0 +1,295 @@
+module;
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+export module protocol;
+
+import std;
+
+import ai;
+import chess_info;
+import point;
+import rule;
+import strings;
+
+namespace {
+
+// Time kept back from every move for I/O and process scheduling.
+constexpr std::chrono::milliseconds safety_margin{50};
+// Share of the remaining match time one move may use.
+constexpr int moves_to_go = 20;
+constexpr int search_depth = 16;
+
+struct limits {
+    std::chrono::milliseconds turn{5000};
+    std::chrono::milliseconds match{0};  // 0: no match limit
+    std::chrono::milliseconds time_left{std::chrono::milliseconds::max()};
+    std::size_t max_memory = 0;          // bytes, 0: no limit
+};
+
+std::optional<point> parse_coordinates(std::string_view text) {
+    int x = 0;
+    int y = 0;
+    const auto comma = text.find(',');
+    if (comma == std::string_view::npos ||
+        std::from_chars(text.data(), text.data() + comma, x).ec != std::errc{} ||
+        std::from_chars(text.data() + comma + 1, text.data() + text.size(), y).ec != std::errc{}) {
+        return std::nullopt;
+    }
+    const point p{x + 1, y + 1};
+    return p.is_on_board<max_board_size>() ? std::optional<point>{p} : std::nullopt;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+    return text;
+}
+
+// Position and engine for one board size. The engine, and with it the TT,
+// is built by the first search: Piskvork sends START before the INFO lines,
+// and max_memory must be known before the table is allocated.
+template <int Size>
+class game {
+public:
+    game(rule::variant rules, std::size_t tt_megabytes)
+        : options_{.depth = search_depth, .rules = rules, .tt_megabytes = tt_megabytes} {}
+
+    [[nodiscard]] bool is_empty(point p) const { return p.is_on_board<Size>() && state_.pieces[p.x][p.y] == 0; }
+    [[nodiscard]] bool is_occupied(point p) const { return p.is_on_board<Size>() && state_.pieces[p.x][p.y] != 0; }
+
+    [[nodiscard]] ai::basic_engine<Size> &engine() {
+        if (!engine_) {
+            engine_ = std::make_unique<ai::basic_engine<Size>>(options_);
+        }
+        return *engine_;
+    }
+
+    void set_rules(rule::variant rules) {
+        options_.rules = rules;
+        if (engine_) engine_->set_rules(rules);
+    }
+
+    void set_tt_megabytes(std::size_t megabytes) {
+        options_.tt_megabytes = megabytes;
+        if (engine_) engine_->set_tt_megabytes(megabytes);
+    }
+
+    void place(point move) {
+        state_.pieces[move.x][move.y] = state_.turn == black_turn ? black_piece : white_piece;
+        state_.current_point = move;
+        state_.turn ^= 1;
+        state_.round += 1;
+    }
+
+    void take_back(point move) {
+        state_.pieces[move.x][move.y] = 0;
+        state_.turn ^= 1;
+        state_.round -= 1;
+    }
+
+    // x,y,who where who is 1 for our stones and 2 for the opponent's.
+    void set_position(const std::vector<std::pair<point, int>> &stones) {
+        state_ = basic_chess_info<Size>{};
+        // The side to move is black when both have the same number of stones.
+        const auto own = std::ranges::count_if(stones, [](const auto &s) { return s.second == 1; });
+        const auto total = static_cast<std::ptrdiff_t>(stones.size());
+        const bool we_are_black = own * 2 == total;
+        for (const auto &[move, who] : stones) {
+            if (!is_empty(move)) continue;
+            const bool black = (who == 1) == we_are_black;
+            state_.pieces[move.x][move.y] = black ? black_piece : white_piece;
+            state_.current_point = move;
+        }
+        state_.round = static_cast<int>(total);
+        state_.turn = total % 2 == 0 ? black_turn : white_turn;
+    }
+
+    [[nodiscard]] point best_point(std::chrono::steady_clock::time_point deadline) {
+        return engine().get_best_point(state_, deadline);
+    }
+
+private:
+    ai::engine_options options_;
+    basic_chess_info<Size> state_;
+    std::unique_ptr<ai::basic_engine<Size>> engine_;
+};
+
+class session {
+public:
+    // Returns false after END.
+    bool handle(std::string_view line) {
+        line = trim(line);
+        const auto space = line.find(' ');
+        std::string command(line.substr(0, space));
+        std::ranges::transform(command, command.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        const auto rest = space == std::string_view::npos ? std::string_view{} : trim(line.substr(space + 1));
+
+        if (command.empty()) {
+            return true;
+        }
+        if (command == "END") {
+            return false;
+        }
+        if (command == "START") {
+            int size = 0;
+            std::from_chars(rest.data(), rest.data() + rest.size(), size);
+            if (size != 15 && size != 19 && size != 20) {
+                reply(std::format("ERROR unsupported board size {}", size));
+                return true;
+            }
+            size_ = size;
+            reset();
+            reply("OK");
+        } else if (command == "RESTART") {
+            reset();
+            reply("OK");
+        } else if (command == "INFO") {
+            info(rest);
+        } else if (command == "BEGIN") {
+            think();
+        } else if (command == "TURN") {
+            const auto move = parse_coordinates(rest);
+            if (!move || !std::visit([&](auto &g) { return g.is_empty(*move); }, game_)) {
+                reply(std::format("ERROR invalid move {}", rest));
+                return true;
+            }
+            std::visit([&](auto &g) { g.place(*move); }, game_);
+            think();
+        } else if (command == "BOARD") {
+            board();
+        } else if (command == "TAKEBACK") {
+            const auto move = parse_coordinates(rest);
+            if (!move || !std::visit([&](auto &g) { return g.is_occupied(*move); }, game_)) {
+                reply(std::format("ERROR invalid takeback {}", rest));
+                return true;
+            }
+            std::visit([&](auto &g) { g.take_back(*move); }, game_);
+            reply("OK");
+        } else if (command == "ABOUT") {
+            reply(R"(name="gomoku", version="1.0", author="modern_gomoku", country="CN")");
+        } else {
+            reply(std::format("UNKNOWN {}", command));
+        }
+        return true;
+    }
+
+private:
+    void reset() {
+        switch (size_) {
+            case 19: game_.emplace<game<19>>(rules_, tt_megabytes()); break;
+            case 20: game_.emplace<game<20>>(rules_, tt_megabytes()); break;
+            default: game_.emplace<game<15>>(rules_, tt_megabytes()); break;
+        }
+    }
+
+    static void reply(std::string_view text) {
+        std::cout << text << '\n';
+        std::cout.flush();
+    }
+
+    void info(std::string_view rest) {
+        const auto space = rest.find(' ');
+        const auto key = rest.substr(0, space);
+        const auto value = space == std::string_view::npos ? std::string_view{} : trim(rest.substr(space + 1));
+        long long number = 0;
+        if (std::from_chars(value.data(), value.data() + value.size(), number).ec != std::errc{}) {
+            return;
+        }
+        if (key == "timeout_turn") {
+            limits_.turn = std::chrono::milliseconds{number};
+        } else if (key == "timeout_match") {
+            limits_.match = std::chrono::milliseconds{number};
+        } else if (key == "time_left") {
+            limits_.time_left = std::chrono::milliseconds{number};
+        } else if (key == "max_memory") {
+            limits_.max_memory = static_cast<std::size_t>(number);
+            std::visit([&](auto &g) { g.set_tt_megabytes(tt_megabytes()); }, game_);
+        } else if (key == "rule") {
+            // Bit 4 selects renju; exactly-five and freestyle both map to freestyle.
+            rules_ = (number & 4) != 0 ? rule::variant::renju : rule::variant::freestyle;
+            std::visit([&](auto &g) { g.set_rules(rules_); }, game_);
+        }
+    }
+
+    // Half of the declared memory goes to the TT; the rest covers search
+    // stacks, the thread pool and the process itself.
+    [[nodiscard]] std::size_t tt_megabytes() const noexcept {
+        if (limits_.max_memory == 0) {
+            return default_tt_megabytes;
+        }
+        return std::max<std::size_t>(1, limits_.max_memory / 2 / (1024 * 1024));
+    }
+
+    [[nodiscard]] std::chrono::milliseconds move_budget() const noexcept {
+        auto budget = limits_.turn.count() > 0 ? limits_.turn : std::chrono::milliseconds{1000};
+        if (limits_.match.count() > 0 && limits_.time_left != std::chrono::milliseconds::max()) {
+            budget = std::min(budget, limits_.time_left / moves_to_go);
+        }
+        return std::max(budget - safety_margin, std::chrono::milliseconds{1});
+    }
+
+    void board() {
+        std::vector<std::pair<point, int>> stones;
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            const auto text = trim(line);
+            if (text == "DONE") {
+                break;
+            }
+            const auto last_comma = text.rfind(',');
+            const auto move = parse_coordinates(text.substr(0, last_comma));
+            int who = 0;
+            if (last_comma == std::string_view::npos || !move ||
+                std::from_chars(text.data() + last_comma + 1, text.data() + text.size(), who).ec != std::errc{}) {
+                continue;
+            }
+            stones.emplace_back(*move, who);
+        }
+        std::visit([&](auto &g) { g.set_position(stones); }, game_);
+        think();
+    }
+
+    void think() {
+        const auto deadline = std::chrono::steady_clock::now() + move_budget();
+        std::visit([&](auto &g) {
+            const point move = g.best_point(deadline);
+            if (!g.is_empty(move)) {
+                reply("ERROR no legal move");
+                return;
+            }
+            const auto &searched = g.engine().last_search();
+            reply(std::format("MESSAGE depth {} score {} nodes {} time {:.3f}", searched.depth, searched.score,
+                              searched.nodes, searched.seconds));
+            g.place(move);
+            reply(std::format("{},{}", move.x - 1, move.y - 1));
+        }, game_);
+    }
+
+    static constexpr std::size_t default_tt_megabytes = 256;
+
+    int size_ = board_rows;
+    limits limits_;
+    rule::variant rules_ = rule::variant::freestyle;
+    std::variant<game<15>, game<19>, game<20>> game_{std::in_place_type<game<15>>, rules_, default_tt_megabytes};
+};
+
+}  // namespace
+
+export namespace protocol {
+
+// Runs the Gomocup (Piskvork) text protocol on stdin/stdout until END or EOF.
+// Logging that would otherwise reach stdout is redirected to stderr.
+void run() {
+    spdlog::set_default_logger(spdlog::stderr_color_mt("protocol_stderr"));
+    session current;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (!current.handle(line)) {
+            break;
+        }
+    }
+}
+
+}  // namespace protocol
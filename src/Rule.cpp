@@ -1,24 +1,27 @@
 module;
 
-#include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/spdlog.h>
 
 export module rule;
 
 import std;
 
+import logging;
 import point;
 import strings;
 
-namespace {
+// Not exported, but outside an anonymous namespace: the board-size templates
+// below are instantiated in importing units and refer to these helpers.
+namespace rule {
 
 constexpr std::array<int, 4> dx_offsets{ -1, 0, -1, -1 };
 constexpr std::array<int, 4> dy_offsets{ 0, -1, -1, 1 };
 
-int count_in_direction(const int (&board)[16][16], point origin, point delta, int color) {
+template <std::size_t N>
+int count_in_direction(const int (&board)[N][N], point origin, point delta, int color) {
     origin += delta;
     int count = 0;
-    while (origin.is_valid()) {
+    while (origin.is_on_board<N - 1>()) {
         if (board[origin.x][origin.y] == color) {
             ++count;
         } else {
@@ -29,34 +32,27 @@ int count_in_direction(const int (&board)[16][16], point origin, point delta, in
     return count;
 }
 
-}  // namespace
+}  // namespace rule
 
 export namespace rule {
 
-[[nodiscard]] std::shared_ptr<spdlog::logger> rule_logger() {
-    static std::shared_ptr<spdlog::logger> logger = [] {
-        if (auto existing = spdlog::get("rule_logger")) {
-            return existing;
-        }
-        try {
-            auto created = spdlog::basic_logger_mt("rule_logger", "rule.log", true);
-            created->set_level(spdlog::level::info);
-            created->flush_on(spdlog::level::info);
-            return created;
-        } catch (const spdlog::spdlog_ex &ex) {
-            spdlog::default_logger()->error("Failed to create rule logger: {}", ex.what());
-            return spdlog::default_logger();
-        }
-    }();
+// Cells of a Size x Size board, indexed from 1 like basic_chess_info::pieces.
+// The free functions below take any such board and deduce its size.
+template <int Size>
+using board_cells = int[Size + 1][Size + 1];
+
+[[nodiscard]] const std::shared_ptr<spdlog::logger> &rule_logger() {
+    static const std::shared_ptr<spdlog::logger> logger = logging::async_file_logger("rule_logger", "rule.log");
     return logger;
 }
 
-std::string collect_sequence(const int (&board)[16][16], point origin, point delta, int steps) {
+template <std::size_t N>
+std::string collect_sequence(const int (&board)[N][N], point origin, point delta, int steps) {
     std::string sequence;
     sequence.reserve(steps);
     for (int index : std::views::iota(0, steps)) {
         origin += delta;
-        if (!origin.is_valid()) {
+        if (!origin.is_on_board<N - 1>()) {
             return "N";
         }
         sequence.push_back(static_cast<char>('0' + board[origin.x][origin.y]));
@@ -64,7 +60,8 @@ std::string collect_sequence(const int (&board)[16][16], point origin, point del
     return sequence;
 }
 
-bool is_win(const int (&board)[16][16], point origin) {
+template <std::size_t N>
+bool is_win(const int (&board)[N][N], point origin) {
     const int color = board[origin.x][origin.y];
     if (count_in_direction(board, origin, point{-1, 0}, color) + count_in_direction(board, origin, point{1, 0}, color) + 1 == 5) {
         return true;
@@ -81,7 +78,10 @@ bool is_win(const int (&board)[16][16], point origin) {
     return false;
 }
 
-bool is_double_three(const int (&board)[16][16], point origin/*, const int color*/) {
+// The shape checks below without logging, for points nobody has played:
+// the forbidden map asks about dozens of them on every move.
+template <std::size_t N>
+bool has_double_three(const int (&board)[N][N], point origin) {
     static const std::array<std::string, 3> triple_patterns{
         "01110",
         "010110",
@@ -110,14 +110,11 @@ bool is_double_three(const int (&board)[16][16], point origin/*, const int color
             }
         }
     }
-    if (matches >= 2) {
-        rule_logger()->info("double_three at ({}, {})", origin.x, origin.y);
-        return true;
-    }
-    return false;
+    return matches >= 2;
 }
 
-bool is_double_four(const int (&board)[16][16], point origin/*, const int color*/) {
+template <std::size_t N>
+bool has_double_four(const int (&board)[N][N], point origin) {
     static const std::array<std::string, 6> quadruple_patterns{
         "011110",
         "11110",
@@ -149,31 +146,268 @@ bool is_double_four(const int (&board)[16][16], point origin/*, const int color*
             }
         }
     }
-    if (matches >= 2) {
-        rule_logger()->info("double_four at ({}, {})", origin.x, origin.y);
+    return matches >= 2;
+}
+
+template <std::size_t N>
+bool is_double_three(const int (&board)[N][N], point origin/*, const int color*/) {
+    if (has_double_three(board, origin)) {
+        logging::hot<spdlog::level::info>(rule_logger, "double_three at ({}, {})", origin.x, origin.y);
         return true;
     }
     return false;
 }
 
-bool is_long_chain(const int (&board)[16][16], point origin, const int color) {
+template <std::size_t N>
+bool is_double_four(const int (&board)[N][N], point origin/*, const int color*/) {
+    if (has_double_four(board, origin)) {
+        logging::hot<spdlog::level::info>(rule_logger, "double_four at ({}, {})", origin.x, origin.y);
+        return true;
+    }
+    return false;
+}
+
+template <std::size_t N>
+bool is_long_chain(const int (&board)[N][N], point origin, const int color) {
     if (count_in_direction(board, origin, point{-1, 0}, color) + count_in_direction(board, origin, point{1, 0}, color) + 1 > 5) {
-        rule_logger()->info("long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
+        logging::hot<spdlog::level::info>(rule_logger, "long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
         return true;
     }
     if (count_in_direction(board, origin, point{0, -1}, color) + count_in_direction(board, origin, point{0, 1}, color) + 1 > 5) {
-        rule_logger()->info("long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
+        logging::hot<spdlog::level::info>(rule_logger, "long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
         return true;
     }
     if (count_in_direction(board, origin, point{-1, -1}, color) + count_in_direction(board, origin, point{1, 1}, color) + 1 > 5) {
-        rule_logger()->info("long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
+        logging::hot<spdlog::level::info>(rule_logger, "long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
         return true;
     }
     if (count_in_direction(board, origin, point{-1, 1}, color) + count_in_direction(board, origin, point{1, -1}, color) + 1 > 5) {
-        rule_logger()->info("long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
+        logging::hot<spdlog::level::info>(rule_logger, "long_chain at ({}, {}), color = {}", origin.x, origin.y, color);
         return true;
     }
     return false;
 }
 
+// Length of the run of same-coloured stones next to every cell, per
+// colour and direction, kept up to date as stones are placed and removed.
+// A stone at `origin` makes five or an overline exactly when rule::is_win
+// or rule::is_long_chain says so, but the question is two table reads per
+// axis instead of a walk along the board.
+template <int Size>
+class basic_run_lengths {
+public:
+    basic_run_lengths() = default;
+    explicit basic_run_lengths(const board_cells<Size> &board) { reset(board); }
+
+    void reset(const board_cells<Size> &board) {
+        runs_ = {};
+        for (int color : {black_piece, white_piece}) {
+            for (int d = 0; d < directions; ++d) {
+                // Walk each line against the direction, so the neighbour a
+                // cell reads from is always already filled in.
+                const auto [dx, dy] = deltas[d];
+                for (int i = 0; i < Size; ++i) {
+                    for (int j = 0; j < Size; ++j) {
+                        const int x = dx > 0 ? Size - i : 1 + i;
+                        const int y = dy > 0 ? Size - j : 1 + j;
+                        update(board, color, d, x, y);
+                    }
+                }
+            }
+        }
+    }
+
+    // Call after board[origin] has been set to `color`, or cleared of it.
+    void place(const board_cells<Size> &board, point origin, int color) { propagate(board, origin, color); }
+    void remove(const board_cells<Size> &board, point origin, int color) { propagate(board, origin, color); }
+
+    [[nodiscard]] int line_length(point origin, int color, int axis) const noexcept {
+        const auto &runs = runs_[color - 1];
+        return runs[axis][origin.x][origin.y] + runs[axis + axes][origin.x][origin.y] + 1;
+    }
+
+    [[nodiscard]] bool is_win(point origin, int color) const noexcept {
+        for (int axis = 0; axis < axes; ++axis) {
+            if (line_length(origin, color, axis) == 5) return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool is_long_chain(point origin, int color) const noexcept {
+        for (int axis = 0; axis < axes; ++axis) {
+            if (line_length(origin, color, axis) > 5) return true;
+        }
+        return false;
+    }
+
+private:
+    static constexpr int axes = 4;
+    static constexpr int directions = 2 * axes;  // direction d + axes is the opposite of d
+    static constexpr std::array<point, directions> deltas{
+        point{1, 0}, point{0, 1}, point{1, 1}, point{1, -1}, point{-1, 0}, point{0, -1}, point{-1, -1}, point{-1, 1}};
+
+    // runs_[color - 1][d][x][y]: stones of that colour starting at (x, y) + deltas[d].
+    using plane = std::array<std::array<std::uint8_t, Size + 1>, Size + 1>;
+    std::array<std::array<plane, directions>, 2> runs_{};
+
+    void update(const board_cells<Size> &board, int color, int d, int x, int y) noexcept {
+        const int nx = x + deltas[d].x;
+        const int ny = y + deltas[d].y;
+        const bool stone = nx >= 1 && nx <= Size && ny >= 1 && ny <= Size && board[nx][ny] == color;
+        runs_[color - 1][d][x][y] = stone ? static_cast<std::uint8_t>(runs_[color - 1][d][nx][ny] + 1) : 0;
+    }
+
+    // Only cells behind `origin` read through it, and only as far as the
+    // run of `color` stones behind it reaches.
+    void propagate(const board_cells<Size> &board, point origin, int color) noexcept {
+        for (int d = 0; d < directions; ++d) {
+            const auto [dx, dy] = deltas[d];
+            for (int x = origin.x - dx, y = origin.y - dy; x >= 1 && x <= Size && y >= 1 && y <= Size; x -= dx, y -= dy) {
+                update(board, color, d, x, y);
+                if (board[x][y] != color) break;
+            }
+        }
+    }
+};
+
+using run_lengths = basic_run_lengths<board_rows>;
+
+// Empty points where black may not play under renju, one bit per point.
+// Whether a point is forbidden depends only on the stones within five
+// cells of it along its four lines, so a placed or removed stone only
+// changes the points on its own lines within that distance.
+template <int Size>
+class basic_forbidden_map {
+public:
+    void reset(const board_cells<Size> &board, const basic_run_lengths<Size> &runs) {
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                refresh(board, runs, x, y);
+            }
+        }
+    }
+
+    // Call after board[changed] and `runs` have been updated.
+    void update(const board_cells<Size> &board, const basic_run_lengths<Size> &runs, point changed) {
+        refresh(board, runs, changed.x, changed.y);
+        for (auto [dx, dy] : std::views::zip(dx_offsets, dy_offsets)) {
+            for (int k = 1; k <= 5; ++k) {
+                for (const point p : {point{changed.x + k * dx, changed.y + k * dy}, point{changed.x - k * dx, changed.y - k * dy}}) {
+                    if (p.is_on_board<Size>()) refresh(board, runs, p.x, p.y);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] bool contains(point p) const noexcept { return (rows_[p.x] >> p.y & 1) != 0; }
+    [[nodiscard]] std::uint32_t row(int x) const noexcept { return rows_[x]; }
+
+private:
+    std::array<std::uint32_t, Size + 1> rows_{};  // bit y of rows_[x]
+
+    void refresh(const board_cells<Size> &board, const basic_run_lengths<Size> &runs, int x, int y) {
+        const auto bit = std::uint32_t{1} << y;
+        if (board[x][y] == 0 && is_forbidden_point(board, runs, point{x, y})) {
+            rows_[x] |= bit;
+        } else {
+            rows_[x] &= ~bit;
+        }
+    }
+
+    // Same answer as renju_rules::is_forbidden<black_piece> after a black
+    // stone is put on `origin`; none of the checks read the origin itself.
+    // A three or four needs two other black stones within four cells on
+    // its line, and the shape checks count at most one per line, so points
+    // with fewer than two such lines skip them.
+    [[nodiscard]] static bool is_forbidden_point(const board_cells<Size> &board, const basic_run_lengths<Size> &runs,
+                                                 point origin) {
+        if (runs.is_win(origin, black_piece)) return false;
+        if (runs.is_long_chain(origin, black_piece)) return true;
+        int crowded_lines = 0;
+        for (auto [dx, dy] : std::views::zip(dx_offsets, dy_offsets)) {
+            int stones = 0;
+            for (int k = -4; k <= 4; ++k) {
+                const point p{origin.x + k * dx, origin.y + k * dy};
+                stones += k != 0 && p.is_on_board<Size>() && board[p.x][p.y] == black_piece;
+            }
+            crowded_lines += stones >= 2;
+        }
+        return crowded_lines >= 2 && (has_double_three(board, origin) || has_double_four(board, origin));
+    }
+};
+
+using forbidden_map = basic_forbidden_map<board_rows>;
+
+enum class variant { renju, freestyle };
+
+// Rule sets used as template arguments by the search, so that which side has
+// forbidden points and what counts as a win are resolved at compile time.
+// A five always takes priority over a forbidden shape.
+struct renju_rules {
+    template <int Piece>
+    static constexpr bool has_forbidden = Piece == black_piece;
+
+    template <int Piece, std::size_t N>
+    [[nodiscard]] static bool is_forbidden(const int (&board)[N][N], point origin) {
+        if constexpr (!has_forbidden<Piece>) {
+            return false;
+        } else {
+            return !is_win(board, origin) &&
+                   (is_double_three(board, origin) || is_double_four(board, origin) || is_long_chain(board, origin, Piece));
+        }
+    }
+
+    template <int Piece, std::size_t N>
+    [[nodiscard]] static bool wins(const int (&board)[N][N], point origin) {
+        if constexpr (Piece == black_piece) {
+            return is_win(board, origin);
+        } else {
+            return is_win(board, origin) || is_long_chain(board, origin, Piece);
+        }
+    }
+
+    template <int Piece, int Size>
+    [[nodiscard]] static bool is_forbidden(const basic_forbidden_map<Size> &forbidden, point origin) {
+        if constexpr (!has_forbidden<Piece>) {
+            return false;
+        } else {
+            return forbidden.contains(origin);
+        }
+    }
+
+    template <int Piece, int Size>
+    [[nodiscard]] static bool wins(const basic_run_lengths<Size> &runs, point origin) {
+        if constexpr (Piece == black_piece) {
+            return runs.is_win(origin, Piece);
+        } else {
+            return runs.is_win(origin, Piece) || runs.is_long_chain(origin, Piece);
+        }
+    }
+};
+
+struct freestyle_rules {
+    template <int Piece>
+    static constexpr bool has_forbidden = false;
+
+    template <int Piece, std::size_t N>
+    [[nodiscard]] static bool is_forbidden(const int (&)[N][N], point) {
+        return false;
+    }
+
+    template <int Piece, std::size_t N>
+    [[nodiscard]] static bool wins(const int (&board)[N][N], point origin) {
+        return is_win(board, origin) || is_long_chain(board, origin, Piece);
+    }
+
+    template <int Piece, int Size>
+    [[nodiscard]] static bool is_forbidden(const basic_forbidden_map<Size> &, point) {
+        return false;
+    }
+
+    template <int Piece, int Size>
+    [[nodiscard]] static bool wins(const basic_run_lengths<Size> &runs, point origin) {
+        return runs.is_win(origin, Piece) || runs.is_long_chain(origin, Piece);
+    }
+};
+
 }  // namespace rule
@@ -0,0 +1,235 @@
+module;
+
+export module search_stack;
+
+import std;
+
+import memory;
+import point;
+import strings;
+
+export namespace search {
+
+inline constexpr int max_moves = max_board_size * max_board_size;
+inline constexpr int max_ply = 64;
+
+struct scored_move {
+    point move;
+    int score{0};
+};
+
+// Fixed-capacity candidate list; never allocates.
+class move_list {
+public:
+    void clear() noexcept { size_ = 0; }
+
+    void push_back(point move, int score = 0) noexcept {
+        entries_[size_++] = scored_move{move, score};
+    }
+
+    [[nodiscard]] int size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+    [[nodiscard]] scored_move &operator[](int index) noexcept { return entries_[index]; }
+    [[nodiscard]] const scored_move &operator[](int index) const noexcept { return entries_[index]; }
+
+    [[nodiscard]] scored_move *begin() noexcept { return entries_.data(); }
+    [[nodiscard]] scored_move *end() noexcept { return entries_.data() + size_; }
+    [[nodiscard]] const scored_move *begin() const noexcept { return entries_.data(); }
+    [[nodiscard]] const scored_move *end() const noexcept { return entries_.data() + size_; }
+
+    // Orders by the precomputed scores, best first.
+    void sort_by_score() noexcept {
+        std::sort(begin(), end(), [](const scored_move &a, const scored_move &b) {
+            return a.score > b.score;
+        });
+    }
+
+    // Moves the best-scored entry of [from, size) to `from`: one step of a
+    // selection sort, for callers that usually stop after a few entries.
+    void select_best(int from) noexcept {
+        int best = from;
+        for (int i = from + 1; i < size_; ++i) {
+            if (entries_[i].score > entries_[best].score) best = i;
+        }
+        std::swap(entries_[from], entries_[best]);
+    }
+
+    // Drops the entries `pred` holds for, keeping the order of the rest.
+    template <typename Pred>
+    void erase_if(Pred pred) noexcept {
+        size_ = static_cast<int>(std::remove_if(begin(), end(), pred) - begin());
+    }
+
+    // Same, but keeps the current order among equal scores.
+    void stable_sort_by_score() noexcept {
+        for (int i = 1; i < size_; ++i) {
+            const scored_move value = entries_[i];
+            int j = i;
+            for (; j > 0 && entries_[j - 1].score < value.score; --j) {
+                entries_[j] = entries_[j - 1];
+            }
+            entries_[j] = value;
+        }
+    }
+
+private:
+    std::array<scored_move, max_moves> entries_{};
+    int size_{0};
+};
+
+struct ply_frame {
+    move_list moves;
+    // Quiet moves that last caused a cutoff at this ply, newest first.
+    std::array<point, 2> killers{point{-1, -1}, point{-1, -1}};
+
+    void add_killer(point move) noexcept {
+        if (killers[0].x == move.x && killers[0].y == move.y) return;
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+};
+
+// Hands out the moves of one node in stages, each run only once the ones
+// before it are used up: the TT move, the forcing moves, the killers, then
+// the quiet moves. Within a stage the moves come best first, each found by
+// one selection step when it is asked for. A node that cuts off early never
+// generates its quiet moves.
+class move_picker {
+public:
+    // `tt_move` must be legal here, or off the board to skip that stage.
+    move_picker(ply_frame &frame, point tt_move) noexcept
+        : moves_{&frame.moves}, tt_move_{tt_move}, killers_{frame.killers} {}
+
+    // `forcing` fills and scores the list with the forcing moves, `usable`
+    // tells whether a killer is a legal quiet move here, and `quiet` fills
+    // and scores the list with the quiet moves. Each runs at most once, when
+    // its stage is reached; moves already handed out are skipped.
+    template <typename Forcing, typename Usable, typename Quiet>
+    [[nodiscard]] std::optional<point> next(Forcing &&forcing, Usable &&usable, Quiet &&quiet) {
+        switch (stage_) {
+            case stage::tt_move:
+                stage_ = stage::generate_forcing;
+                if (tt_move_.x >= 1) return tt_move_;
+                [[fallthrough]];
+            case stage::generate_forcing:
+                forcing(*moves_);
+                next_ = 0;
+                stage_ = stage::forcing;
+                [[fallthrough]];
+            case stage::forcing:
+                if (const auto move = take_best()) return move;
+                stage_ = stage::killers;
+                [[fallthrough]];
+            case stage::killers:
+                while (killer_ < static_cast<int>(killers_.size())) {
+                    const point move = killers_[killer_++];
+                    if (move.x >= 1 && !same(move, tt_move_) && usable(move)) {
+                        handed_killers_[killer_ - 1] = move;
+                        return move;
+                    }
+                }
+                [[fallthrough]];
+            case stage::generate_quiet:
+                quiet(*moves_);
+                next_ = 0;
+                stage_ = stage::quiet;
+                [[fallthrough]];
+            case stage::quiet:
+                return take_best();
+        }
+        return std::nullopt;
+    }
+
+private:
+    enum class stage { tt_move, generate_forcing, forcing, killers, generate_quiet, quiet };
+
+    [[nodiscard]] static bool same(point a, point b) noexcept { return a.x == b.x && a.y == b.y; }
+
+    [[nodiscard]] std::optional<point> take_best() noexcept {
+        while (next_ < moves_->size()) {
+            moves_->select_best(next_);
+            const point move = (*moves_)[next_++].move;
+            if (!same(move, tt_move_) && !same(move, handed_killers_[0]) && !same(move, handed_killers_[1])) return move;
+        }
+        return std::nullopt;
+    }
+
+    move_list *moves_;
+    point tt_move_;
+    std::array<point, 2> killers_;
+    std::array<point, 2> handed_killers_{point{-1, -1}, point{-1, -1}};
+    stage stage_ = stage::tt_move;
+    int killer_ = 0;
+    int next_ = 0;
+};
+
+// One per worker thread; frame `ply` belongs to the node at that distance from the root.
+struct stack {
+    std::array<ply_frame, max_ply> frames{};
+};
+
+// Stacks are allocated once up front, in huge pages when available, and
+// leased to root-move tasks. At most `capacity` tasks run at the same time,
+// so a free stack always exists. A stack is constructed, and its pages
+// first touched, by the first thread that leases it, and a thread goes back
+// to the stack it had last, so stacks stay on their threads' NUMA nodes.
+class stack_arena {
+    static_assert(std::is_trivially_destructible_v<stack>);
+
+public:
+    explicit stack_arena(unsigned capacity)
+        : storage_(std::size_t{capacity} * sizeof(stack)), constructed_(capacity), busy_(capacity) {}
+
+    class lease {
+    public:
+        lease(stack_arena &arena, std::size_t index) noexcept : arena_{&arena}, index_{index} {}
+        lease(const lease &) = delete;
+        lease &operator=(const lease &) = delete;
+        ~lease() { arena_->busy_[index_].store(false, std::memory_order_release); }
+
+        [[nodiscard]] stack &get() const noexcept { return arena_->stacks()[index_]; }
+
+    private:
+        stack_arena *arena_;
+        std::size_t index_;
+    };
+
+    [[nodiscard]] lease acquire() {
+        std::size_t &last = last_index();
+        while (true) {
+            for (std::size_t k = 0; k < busy_.size(); ++k) {
+                const std::size_t i = (last + k) % busy_.size();
+                if (!busy_[i].load(std::memory_order_relaxed) &&
+                    !busy_[i].exchange(true, std::memory_order_acquire)) {
+                    if (!constructed_[i]) {
+                        new (&stacks()[i]) stack{};
+                        constructed_[i] = true;
+                    }
+                    last = i;
+                    return lease{*this, i};
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    [[nodiscard]] stack *stacks() const noexcept { return static_cast<stack *>(storage_.data()); }
+
+    // The stack the calling thread had last in this arena. A thread may use
+    // several arenas (one per engine), so the hints are kept per arena; an
+    // arena at the address of a destroyed one inherits a harmless hint.
+    [[nodiscard]] std::size_t &last_index() {
+        static thread_local std::vector<std::pair<const stack_arena *, std::size_t>> hints;
+        const auto known = std::ranges::find(hints, this, &std::pair<const stack_arena *, std::size_t>::first);
+        if (known != hints.end()) return known->second;
+        return hints.emplace_back(this, 0).second;
+    }
+
+    memory::large_buffer storage_;
+    std::vector<char> constructed_;  // written only by the stack's lease holder
+    std::vector<std::atomic<bool>> busy_;
+};
+
+}  // namespace search
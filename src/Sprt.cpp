@@ -0,0 +1,186 @@
+module;
+
+export module sprt;
+
+import std;
+
+import match_runner;
+
+namespace {
+
+[[nodiscard]] double expected_score(double elo) {
+    return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+[[nodiscard]] double elo_from_score(double score) {
+    score = std::clamp(score, 1e-6, 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+}  // namespace
+
+export namespace sprt {
+
+struct sprt_options {
+    match::match_options match;
+    double elo0 = 0.0;
+    double elo1 = 5.0;
+    double alpha = 0.05;
+    double beta = 0.05;
+};
+
+enum class verdict { running, accept_h1, accept_h0, inconclusive };
+
+// Results are counted per opening pair (both colours), which removes most of
+// the variance an unbalanced opening adds. Index k holds pairs in which the
+// first engine scored k/2 points out of 2.
+struct pentanomial {
+    std::array<int, 5> counts{};
+
+    [[nodiscard]] int pairs() const noexcept {
+        return std::accumulate(counts.begin(), counts.end(), 0);
+    }
+
+    [[nodiscard]] double mean() const noexcept {
+        double total = 0.0;
+        for (int k = 0; k < 5; ++k) total += counts[k] * (k / 4.0);
+        return pairs() > 0 ? total / pairs() : 0.5;
+    }
+
+    [[nodiscard]] double variance() const noexcept {
+        if (pairs() == 0) return 0.0;
+        const double m = mean();
+        double total = 0.0;
+        for (int k = 0; k < 5; ++k) total += counts[k] * (k / 4.0 - m) * (k / 4.0 - m);
+        return total / pairs();
+    }
+
+    // Generalized SPRT log-likelihood ratio of elo1 against elo0 under the
+    // normal approximation of the per-pair score.
+    [[nodiscard]] double llr(double elo0, double elo1) const noexcept {
+        const double var = variance();
+        if (var <= 0.0) return 0.0;
+        const double s0 = expected_score(elo0);
+        const double s1 = expected_score(elo1);
+        return pairs() * (s1 - s0) * (2.0 * mean() - s0 - s1) / (2.0 * var);
+    }
+
+    // Elo estimate and the half width of its 95% confidence interval.
+    [[nodiscard]] std::pair<double, double> elo() const noexcept {
+        const double m = mean();
+        const double margin = pairs() > 0 ? 1.96 * std::sqrt(variance() / pairs()) : 0.5;
+        const double low = elo_from_score(m - margin);
+        const double high = elo_from_score(m + margin);
+        return {elo_from_score(m), (high - low) / 2.0};
+    }
+};
+
+struct sprt_result {
+    verdict outcome = verdict::running;
+    pentanomial pairs;
+    match::match_summary games;
+    double llr = 0.0;
+    double lower_bound = 0.0;
+    double upper_bound = 0.0;
+};
+
+[[nodiscard]] std::string_view to_string(verdict value) noexcept {
+    switch (value) {
+        case verdict::accept_h1: return "H1 accepted (not worse than elo1)";
+        case verdict::accept_h0: return "H0 accepted (not better than elo0)";
+        case verdict::inconclusive: return "inconclusive (game limit reached)";
+        case verdict::running: break;
+    }
+    return "running";
+}
+
+// Plays paired-opening games until the LLR leaves [ln(beta/(1-alpha)),
+// ln((1-beta)/alpha)] or options.match.games is exhausted. `progress` is
+// called after every finished pair. Returns nothing if the match cannot
+// start (see match::run_match).
+std::optional<sprt_result> run(const sprt_options &options, const std::function<void(const sprt_result &)> &progress = {}) {
+    sprt_result state;
+    state.lower_bound = std::log(options.beta / (1.0 - options.alpha));
+    state.upper_bound = std::log((1.0 - options.beta) / options.alpha);
+
+    std::unordered_map<int, int> half_pairs;  // pair index -> first game's score + 1
+    const auto games = match::run_match(options.match, [&](const match::game_result &game, const match::match_summary &) {
+        // Games still running when a bound was crossed finish afterwards;
+        // they must not move the LLR the verdict was taken on.
+        if (state.outcome != verdict::running) {
+            return false;
+        }
+        const int pair = game.index / 2;
+        const int score = game.first_score() + 1;  // 0 loss, 1 draw, 2 win
+        const auto it = half_pairs.find(pair);
+        if (it == half_pairs.end()) {
+            half_pairs.emplace(pair, score);
+            return true;
+        }
+        ++state.pairs.counts[it->second + score];
+        half_pairs.erase(it);
+
+        state.llr = state.pairs.llr(options.elo0, options.elo1);
+        if (state.llr >= state.upper_bound) {
+            state.outcome = verdict::accept_h1;
+        } else if (state.llr <= state.lower_bound) {
+            state.outcome = verdict::accept_h0;
+        }
+        if (progress) {
+            progress(state);
+        }
+        return state.outcome == verdict::running;
+    });
+    if (!games) {
+        return std::nullopt;
+    }
+    state.games = *games;
+    if (state.outcome == verdict::running) {
+        state.outcome = verdict::inconclusive;
+    }
+    return state;
+}
+
+// Reads --elo0, --elo1, --alpha, --beta and --max-games; everything else is
+// passed on to match::parse_options.
+[[nodiscard]] std::optional<sprt_options> parse_options(const std::vector<std::string_view> &args) {
+    sprt_options options;
+    std::optional<double> max_games;
+    std::vector<std::string_view> rest;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const auto flag = args[i];
+        if (flag == "--sprt") {
+            continue;
+        }
+        const bool own = flag == "--elo0" || flag == "--elo1" || flag == "--alpha" || flag == "--beta" || flag == "--max-games";
+        if (!own) {
+            rest.push_back(flag);
+            continue;
+        }
+        if (i + 1 >= args.size()) {
+            return std::nullopt;
+        }
+        const std::string value(args[++i]);
+        char *end = nullptr;
+        const double number = std::strtod(value.c_str(), &end);
+        if (end == value.c_str() || *end != '\0') {
+            return std::nullopt;
+        }
+        if (flag == "--elo0") options.elo0 = number;
+        else if (flag == "--elo1") options.elo1 = number;
+        else if (flag == "--alpha") options.alpha = number;
+        else if (flag == "--beta") options.beta = number;
+        else max_games = number;
+    }
+    auto match_options = match::parse_options(rest);
+    if (!match_options || options.elo1 <= options.elo0 || options.alpha <= 0.0 || options.beta <= 0.0) {
+        return std::nullopt;
+    }
+    options.match = std::move(*match_options);
+    options.match.games = static_cast<int>(max_games.value_or(20000));
+    // Whole pairs only.
+    options.match.games -= options.match.games % 2;
+    return options;
+}
+
+}  // namespace sprt
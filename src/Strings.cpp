@@ -6,3 +6,10 @@ export inline constexpr int black_turn = 0;
 export inline constexpr int white_turn = 1;
 export inline constexpr int black_piece = 1;
 export inline constexpr int white_piece = 2;
+
+// Board sizes the engine is built for. Board-sized code takes the size as a
+// template argument; board_rows x board_cols is the default and the renju size.
+export template <int Size>
+concept board_size = Size == 15 || Size == 19 || Size == 20;
+
+export inline constexpr int max_board_size = 20;
@@ -4,6 +4,9 @@ export module tool;
 
 import std;
 
+import point;
+import strings;
+
 export namespace tool {
 
 int parse_row(char c) {
@@ -16,6 +19,7 @@ int parse_row(char c) {
     return -1;
 }
 
+template <int Size = board_cols>
 int parse_col(const std::string &s) {
     if (s.empty()) {
         return -1;
@@ -28,7 +32,43 @@ int parse_col(const std::string &s) {
             return -1;
         }
     }
-    return (num >= 1 && num <= 15) ? num : -1;
+    return (num >= 1 && num <= Size) ? num : -1;
+}
+
+// Inverse of parse_row/parse_col, e.g. point{8, 8} -> "h8".
+std::string format_move(point p) {
+    return std::format("{}{}", static_cast<char>('a' + p.x - 1), p.y);
+}
+
+template <int Size = board_rows>
+std::optional<point> parse_move(std::string_view text) {
+    if (text.size() < 2U) {
+        return std::nullopt;
+    }
+    point candidate{parse_row(text.front()), parse_col<Size>(std::string(text.substr(1)))};
+    if (!candidate.is_on_board<Size>()) {
+        return std::nullopt;
+    }
+    return candidate;
+}
+
+// FNV-1a, used for file and table fingerprints; chain calls through `hash`.
+[[nodiscard]] constexpr std::uint64_t fnv1a(std::span<const std::byte> bytes,
+                                            std::uint64_t hash = 0xcbf29ce484222325ULL) noexcept {
+    for (const std::byte b : bytes) {
+        hash = (hash ^ std::to_integer<std::uint64_t>(b)) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// SplitMix64: advances `state` and returns the next output. Unlike the
+// <random> engines it runs in constant expressions, for tables of keys
+// generated at compile time.
+[[nodiscard]] constexpr std::uint64_t splitmix64(std::uint64_t &state) noexcept {
+    std::uint64_t z = state += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
 }
 
 }  // namespace tool
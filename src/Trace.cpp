@@ -0,0 +1,245 @@
+module;
+
+#include <spdlog/spdlog.h>
+
+#ifndef GOMOKU_TRACE
+#define GOMOKU_TRACE 0
+#endif
+
+export module trace;
+
+import std;
+
+import point;
+
+namespace {
+
+constexpr std::size_t events_per_thread = 1 << 16;
+
+struct event {
+    const char *name;
+    const char *category;
+    std::int64_t start_ns;
+    std::int64_t duration_ns;
+    point at{-1, -1};
+};
+
+// Written only by its thread while that thread runs a task of the owning
+// recorder's engine; the recorder reads up to `size` after that engine's
+// search has joined, so publishing the size with release ordering is enough.
+struct thread_buffer {
+    std::thread::id thread;
+    int tid;
+    std::atomic<std::size_t> size{0};
+    std::atomic<std::size_t> dropped{0};
+    std::array<event, events_per_thread> events;
+};
+
+std::atomic<bool> recording{false};
+std::filesystem::path output_dir;
+std::atomic<int> dumped_moves{0};
+std::atomic<int> next_tid{1};
+
+// The buffer spans on this thread record into, set by trace::scope.
+thread_local thread_buffer *current_buffer = nullptr;
+
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// Stable per thread, so one thread has the same tid in every engine's files.
+int thread_tid() {
+    thread_local const int tid = next_tid.fetch_add(1, std::memory_order_relaxed);
+    return tid;
+}
+
+std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char *name, const char *category, std::int64_t start_ns, std::int64_t end_ns, point at) {
+    auto *buffer = current_buffer;
+    if (buffer == nullptr) {
+        return;
+    }
+    const std::size_t index = buffer->size.load(std::memory_order_relaxed);
+    if (index == events_per_thread) {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer->events[index] = event{name, category, start_ns, end_ns - start_ns, at};
+    buffer->size.store(index + 1, std::memory_order_release);
+}
+
+}  // namespace
+
+export namespace trace {
+
+inline constexpr bool compiled_in = GOMOKU_TRACE != 0;
+
+// Spans shorter than this are not recorded by slow_span.
+inline constexpr std::int64_t slow_span_threshold_ns = 2000;
+
+[[nodiscard]] bool active() noexcept {
+    if constexpr (compiled_in) {
+        return recording.load(std::memory_order_relaxed);
+    } else {
+        return false;
+    }
+}
+
+// Starts recording; one Chrome Trace Event file per move is written to `dir`.
+// Returns false if tracing was compiled out.
+bool start(const std::filesystem::path &dir) {
+    if constexpr (!compiled_in) {
+        return false;
+    } else {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        output_dir = dir;
+        recording.store(true, std::memory_order_relaxed);
+        return true;
+    }
+}
+
+// RAII span on the calling thread. Compiles to nothing without GOMOKU_TRACE.
+class span {
+public:
+    explicit span(const char *name, const char *category, point at = point{-1, -1}) noexcept {
+        if constexpr (compiled_in) {
+            if (active()) {
+                name_ = name;
+                category_ = category;
+                at_ = at;
+                start_ns_ = now_ns();
+            }
+        }
+    }
+
+    ~span() {
+        if constexpr (compiled_in) {
+            if (name_ != nullptr) {
+                record(name_, category_, start_ns_, now_ns(), at_);
+            }
+        }
+    }
+
+    span(const span &) = delete;
+    span &operator=(const span &) = delete;
+
+protected:
+    const char *name_ = nullptr;
+    const char *category_ = nullptr;
+    std::int64_t start_ns_ = 0;
+    point at_{-1, -1};
+};
+
+// Like span, but only kept when it took longer than slow_span_threshold_ns;
+// used for frequent operations such as TT stores, where only stalls matter.
+class slow_span : public span {
+public:
+    using span::span;
+
+    ~slow_span() {
+        if constexpr (compiled_in) {
+            if (name_ != nullptr && now_ns() - start_ns_ < slow_span_threshold_ns) {
+                name_ = nullptr;
+            }
+        }
+    }
+};
+
+// The events of one engine, one buffer per thread that ran its search.
+// Engines sharing a thread pool each have their own recorder, so dumping
+// one never touches a buffer another engine's search is writing.
+class recorder {
+public:
+    recorder() = default;
+    recorder(const recorder &) = delete;
+    recorder &operator=(const recorder &) = delete;
+
+    // Writes this engine's events since the previous dump as one Chrome
+    // Trace Event JSON file and clears its buffers. Call only while this
+    // engine's search is not running.
+    void dump_move() {
+        if (!active()) {
+            return;
+        }
+        const auto path = output_dir / std::format("move_{:04}.json", dumped_moves.fetch_add(1));
+        std::ofstream out(path);
+        if (!out) {
+            spdlog::default_logger()->error("trace: cannot write {}", path.string());
+            return;
+        }
+
+        std::lock_guard lock(mutex_);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        const auto separator = [&] {
+            if (!first) out << ",\n";
+            first = false;
+        };
+        for (const auto &buffer : buffers_) {
+            separator();
+            out << std::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"thread {}"}}}})",
+                               buffer->tid, buffer->tid);
+            const std::size_t size = buffer->size.load(std::memory_order_acquire);
+            for (const auto &e : std::span(buffer->events).first(size)) {
+                separator();
+                out << std::format(R"({{"name":"{}","cat":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f})",
+                                   e.name, e.category, buffer->tid, e.start_ns / 1000.0, e.duration_ns / 1000.0);
+                if (e.at.x >= 0) {
+                    out << std::format(R"(,"args":{{"x":{},"y":{}}})", e.at.x, e.at.y);
+                }
+                out << '}';
+            }
+            if (const auto dropped = buffer->dropped.exchange(0); dropped > 0) {
+                separator();
+                out << std::format(R"({{"name":"dropped_events","ph":"i","s":"t","pid":1,"tid":{},"ts":0,"args":{{"count":{}}}}})",
+                                   buffer->tid, dropped);
+            }
+            buffer->size.store(0, std::memory_order_relaxed);
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    friend class scope;
+
+    thread_buffer &local_buffer() {
+        std::lock_guard lock(mutex_);
+        const auto id = std::this_thread::get_id();
+        const auto known = std::ranges::find(buffers_, id, &thread_buffer::thread);
+        if (known != buffers_.end()) {
+            return **known;
+        }
+        auto &created = buffers_.emplace_back(std::make_unique<thread_buffer>());
+        created->thread = id;
+        created->tid = thread_tid();
+        return *created;
+    }
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<thread_buffer>> buffers_;
+};
+
+// Directs the calling thread's spans to `owner` until destroyed. Open one
+// at the start of every task of a search, before its first span.
+class scope {
+public:
+    explicit scope(recorder &owner) : previous_(current_buffer) {
+        if constexpr (compiled_in) {
+            if (active()) {
+                current_buffer = &owner.local_buffer();
+            }
+        }
+    }
+
+    ~scope() { current_buffer = previous_; }
+
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+
+private:
+    thread_buffer *previous_;
+};
+
+}  // namespace trace
@@ -0,0 +1,545 @@
+module;
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#include <spdlog/spdlog.h>
+
+export module transposition_table;
+
+import std;
+
+import memory;
+import point;
+
+// Snapshot file layout (little endian):
+//   char     magic[8]              "GMKTT\0\0\0"
+//   uint32   version               snapshot_version
+//   uint32   slot_size             16
+//   uint64   key_signature         fingerprint of the Zobrist keys
+//   uint64   evaluator_signature   fingerprint of the evaluator
+//   uint64   count
+//   record   records[count]        in table order, empty slots omitted
+//
+// A snapshot is only meaningful to a search that hashes positions and
+// scores leaves exactly as the one that wrote it; loading checks both
+// signatures and rejects the file otherwise.
+
+namespace {
+
+constexpr std::array<char, 8> snapshot_magic{'G', 'M', 'K', 'T', 'T', '\0', '\0', '\0'};
+constexpr std::uint32_t snapshot_version = 1;
+
+constexpr std::array<char, 8> shared_magic{'G', 'M', 'K', 'T', 'T', 'S', 'H', 'M'};
+constexpr std::uint32_t shared_version = 1;
+// How long attaching waits for another process still creating the table.
+constexpr int attach_attempts = 200;
+constexpr std::chrono::milliseconds attach_interval{10};
+
+}  // namespace
+
+export namespace tt {
+
+enum bound : std::int8_t { exact = 0, lower = 1, upper = 2 };
+
+struct entry {
+    int value{0};
+    int flag{exact};
+    int depth{0};
+    point best_move{-1, -1};
+};
+
+struct snapshot_signature {
+    std::uint64_t keys{0};
+    std::uint64_t evaluator{0};
+};
+
+// Fixed-size table sized from a memory budget. Keys map to a bucket of
+// four slots (one cache line); a store replaces the matching key or else
+// the shallowest slot.
+//
+// Slots are lock-free: a slot holds the packed entry and the key XORed
+// with it, each written with one relaxed atomic store. A reader that sees
+// half of a concurrent store finds a key that does not match and treats
+// the slot as a miss. Nothing in a slot points into process memory, so
+// the same scheme works for a table in shared memory (open_shared), used
+// by several processes at once.
+class table {
+    struct slot {
+        std::uint64_t check{0};  // key ^ data
+        std::uint64_t data{0};   // pack(entry); all zero is an empty slot
+    };
+    static_assert(sizeof(slot) == 16);
+    static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free);
+
+    static constexpr std::size_t bucket_slots = 4;
+    struct alignas(64) bucket {
+        std::array<slot, bucket_slots> slots{};
+    };
+
+    // Start of a shared-memory table; the buckets follow. The creator
+    // fills it in and sets `ready` last.
+    struct alignas(64) shared_header {
+        std::array<char, 8> magic{};
+        std::uint32_t version{0};
+        std::uint32_t slot_size{0};
+        std::uint64_t key_signature{0};
+        std::uint64_t evaluator_signature{0};
+        std::uint64_t buckets{0};
+        std::uint32_t ready{0};
+    };
+
+    // Snapshot file record; see the layout at the top of the file.
+    struct record {
+        std::uint64_t key{0};
+        std::int32_t value{0};
+        std::int8_t flag{exact};
+        std::int8_t depth{-1};
+        std::int8_t x{-1};
+        std::int8_t y{-1};
+    };
+    static_assert(sizeof(record) == 16);
+
+public:
+    // Private tables are placed in huge pages when available and spread
+    // over the NUMA nodes as `where` says.
+    explicit table(std::size_t megabytes, memory::placement where = memory::placement::interleave) : placement_(where) {
+        resize(megabytes);
+    }
+
+    table(const table &) = delete;
+    table &operator=(const table &) = delete;
+
+    ~table() { unmap(); }
+
+    // Attaches to the POSIX shared-memory table `name`, or creates it with
+    // room for `megabytes` if there is none. An existing table keeps the
+    // size it was created with, and is only attached if it was created
+    // with the same signature. The segment outlives the processes using it
+    // until it is unlinked (on Linux, removed from /dev/shm). Returns
+    // nullptr, and logs the reason, on failure.
+    [[nodiscard]] static std::shared_ptr<table> open_shared(std::string_view name, std::size_t megabytes,
+                                                           const snapshot_signature &signature) {
+#ifdef _WIN32
+        spdlog::default_logger()->error("tt: shared tables need POSIX shared memory ({})", name);
+        return nullptr;
+#else
+        const std::string path = name.starts_with('/') ? std::string(name) : "/" + std::string(name);
+        // The creator holds an exclusive flock on the segment until it is
+        // ready. A segment that is not ready and not locked was left by a
+        // creator that died; it is removed and created again, once.
+        for (int attempt = 0;; ++attempt) {
+            const auto opened = open_segment(path, megabytes, signature, attempt == 0);
+            if (opened.shared || !opened.stale) return opened.shared;
+        }
+#endif
+    }
+
+    // A shared table keeps the size it was created with.
+    void resize(std::size_t megabytes) {
+        if (mapping_) {
+            spdlog::default_logger()->error("tt: a shared table cannot be resized");
+            return;
+        }
+        const std::size_t buckets = bucket_count(megabytes);
+        // Free the old table first, so the peak is one table, not two.
+        buckets_ = {};
+        owned_ = {};
+        owned_ = memory::large_buffer(buckets * sizeof(bucket));
+        owned_.place(placement_);
+        buckets_ = std::span(static_cast<bucket *>(owned_.data()), buckets);
+        mask_ = buckets - 1;
+    }
+
+    [[nodiscard]] std::size_t size_in_bytes() const noexcept { return buckets_.size() * sizeof(bucket); }
+
+    [[nodiscard]] bool is_shared() const noexcept { return mapping_ != nullptr; }
+
+    std::optional<entry> find(std::uint64_t key) const {
+        for (const auto &s : buckets_[key & mask_].slots) {
+            const auto [stored_key, data] = load(s);
+            if (stored_key == key && data != 0) {
+                return unpack(data);
+            }
+        }
+        return std::nullopt;
+    }
+
+    void insert(std::uint64_t key, const entry &value) {
+        auto &slots = buckets_[key & mask_].slots;
+        slot *target = &slots[0];
+        int target_depth = std::numeric_limits<int>::max();
+        for (auto &s : slots) {
+            const auto [stored_key, data] = load(s);
+            if (stored_key == key) {
+                target = &s;
+                break;
+            }
+            const int depth = data == 0 ? -1 : unpack(data).depth;
+            if (depth < target_depth) {
+                target = &s;
+                target_depth = depth;
+            }
+        }
+        store(*target, key, pack(value));
+    }
+
+    void clear() {
+        for (auto &b : buckets_) {
+            for (auto &s : b.slots) {
+                store(s, 0, 0);
+            }
+        }
+    }
+
+    // Writes entries searched to at least `min_depth`. Returns false (and
+    // logs) on I/O failure. Concurrent inserts may or may not be captured.
+    // The file is written next to `path` and renamed over it at the end, so
+    // an interrupted save never leaves a half-written snapshot behind.
+    bool save(const std::filesystem::path &path, const snapshot_signature &signature, int min_depth = 1) const {
+        auto staging = path;
+        staging += ".tmp";
+        std::ofstream out(staging, std::ios::binary | std::ios::trunc);
+        std::uint64_t count = 0;
+        const std::uint32_t slot_size = sizeof(record);
+        out.write(snapshot_magic.data(), snapshot_magic.size());
+        write_value(out, snapshot_version);
+        write_value(out, slot_size);
+        write_value(out, signature.keys);
+        write_value(out, signature.evaluator);
+        const auto count_offset = out.tellp();
+        write_value(out, count);
+
+        std::vector<record> batch;
+        batch.reserve(bucket_slots * 1024);
+        const auto flush = [&] {
+            out.write(reinterpret_cast<const char *>(batch.data()), static_cast<std::streamsize>(batch.size() * sizeof(record)));
+            count += batch.size();
+            batch.clear();
+        };
+        for (const auto &b : buckets_) {
+            for (const auto &s : b.slots) {
+                const auto [key, data] = load(s);
+                if (data == 0) continue;
+                const entry e = unpack(data);
+                if (e.depth >= min_depth) {
+                    batch.push_back(record{key, e.value, static_cast<std::int8_t>(e.flag), static_cast<std::int8_t>(e.depth),
+                                           static_cast<std::int8_t>(e.best_move.x), static_cast<std::int8_t>(e.best_move.y)});
+                }
+            }
+            if (batch.size() + bucket_slots > batch.capacity()) flush();
+        }
+        flush();
+        out.seekp(count_offset);
+        write_value(out, count);
+        out.close();
+        std::error_code error;
+        if (out) {
+            std::filesystem::rename(staging, path, error);
+        }
+        if (!out || error) {
+            spdlog::default_logger()->error("tt: cannot write snapshot {}", path.string());
+            return false;
+        }
+        return true;
+    }
+
+    // Inserts every entry of a snapshot through the normal replacement
+    // policy, so the table may be any size. Returns the number of entries
+    // read, or nullopt (and logs the reason) for a missing, truncated or
+    // incompatible file.
+    std::optional<std::uint64_t> load(const std::filesystem::path &path, const snapshot_signature &signature) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            spdlog::default_logger()->error("tt: cannot open snapshot {}", path.string());
+            return std::nullopt;
+        }
+        std::array<char, 8> magic{};
+        std::uint32_t version = 0;
+        std::uint32_t slot_size = 0;
+        snapshot_signature stored;
+        std::uint64_t count = 0;
+        in.read(magic.data(), magic.size());
+        read_value(in, version);
+        read_value(in, slot_size);
+        read_value(in, stored.keys);
+        read_value(in, stored.evaluator);
+        read_value(in, count);
+        if (!in || magic != snapshot_magic || version != snapshot_version || slot_size != sizeof(record)) {
+            spdlog::default_logger()->error("tt: {} is not a version {} snapshot", path.string(), snapshot_version);
+            return std::nullopt;
+        }
+        if (stored.keys != signature.keys || stored.evaluator != signature.evaluator) {
+            spdlog::default_logger()->error("tt: snapshot {} was written with other hash keys or another evaluator",
+                                            path.string());
+            return std::nullopt;
+        }
+
+        std::vector<record> batch(bucket_slots * 1024);
+        for (std::uint64_t remaining = count; remaining > 0;) {
+            const auto n = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, batch.size()));
+            in.read(reinterpret_cast<char *>(batch.data()), static_cast<std::streamsize>(n * sizeof(record)));
+            if (!in) {
+                spdlog::default_logger()->error("tt: snapshot {} is truncated", path.string());
+                return std::nullopt;
+            }
+            for (const auto &s : std::span(batch).first(n)) {
+                insert(s.key, entry{s.value, s.flag, s.depth, point{s.x, s.y}});
+            }
+            remaining -= n;
+        }
+        return count;
+    }
+
+private:
+    table() = default;
+
+#ifndef _WIN32
+    struct opened_segment {
+        std::shared_ptr<table> shared;
+        bool stale = false;  // left uninitialized by a dead creator and now removed
+    };
+
+    // One attempt of open_shared; `may_recover` allows removing a stale segment.
+    [[nodiscard]] static opened_segment open_segment(const std::string &path, std::size_t megabytes,
+                                                     const snapshot_signature &signature, bool may_recover) {
+        bool created = true;
+        int fd = ::shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            ::flock(fd, LOCK_EX);
+        } else if (errno == EEXIST) {
+            created = false;
+            fd = ::shm_open(path.c_str(), O_RDWR, 0);
+        }
+        if (fd < 0) {
+            spdlog::default_logger()->error("tt: cannot open shared table {}: {}", path, std::strerror(errno));
+            return {};
+        }
+
+        std::size_t buckets = bucket_count(megabytes);
+        std::size_t bytes = sizeof(shared_header) + buckets * sizeof(bucket);
+        if (created) {
+            if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+                spdlog::default_logger()->error("tt: cannot size shared table {}: {}", path, std::strerror(errno));
+                ::shm_unlink(path.c_str());
+                ::close(fd);
+                return {};
+            }
+        } else {
+            // The creator sizes the segment right after creating it.
+            struct stat status{};
+            for (int attempt = 0; ::fstat(fd, &status) == 0 && std::cmp_less(status.st_size, sizeof(shared_header)) &&
+                                  attempt < attach_attempts;
+                 ++attempt) {
+                std::this_thread::sleep_for(attach_interval);
+            }
+            bytes = static_cast<std::size_t>(status.st_size);
+        }
+        void *mapping = bytes >= sizeof(shared_header)
+                            ? ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                            : MAP_FAILED;
+        if (mapping == MAP_FAILED && (created || bytes != 0)) {
+            spdlog::default_logger()->error("tt: cannot map shared table {}", path);
+            ::close(fd);
+            return {};
+        }
+
+        if (created) {
+            auto &header = *static_cast<shared_header *>(mapping);
+            header.magic = shared_magic;
+            header.version = shared_version;
+            header.slot_size = sizeof(slot);
+            header.key_signature = signature.keys;
+            header.evaluator_signature = signature.evaluator;
+            header.buckets = buckets;
+            std::atomic_ref(header.ready).store(1, std::memory_order_release);
+            ::close(fd);  // drops the lock
+            return {wrap(mapping, bytes, buckets)};
+        }
+
+        // An empty segment was never sized, so it is no more ready than one
+        // whose header is still blank.
+        const auto is_ready = [&] {
+            return mapping != MAP_FAILED &&
+                   std::atomic_ref(static_cast<shared_header *>(mapping)->ready).load(std::memory_order_acquire) != 0;
+        };
+        for (int attempt = 0; !is_ready() && mapping != MAP_FAILED && attempt < attach_attempts; ++attempt) {
+            std::this_thread::sleep_for(attach_interval);
+        }
+        std::string_view problem;
+        if (!is_ready()) {
+            if (::flock(fd, LOCK_EX | LOCK_NB) == 0) {
+                // No creator holds the lock, so it died before finishing.
+                if (may_recover && same_segment(path, fd)) {
+                    spdlog::default_logger()->warn("tt: shared table {} was left uninitialized, creating it again", path);
+                    ::shm_unlink(path.c_str());
+                    if (mapping != MAP_FAILED) ::munmap(mapping, bytes);
+                    ::close(fd);
+                    return {nullptr, true};
+                }
+                problem = "was never initialized; remove it (shm_unlink, or the file under /dev/shm) and retry";
+            } else {
+                problem = "is still being initialized by another process";
+            }
+        } else {
+            const auto &header = *static_cast<const shared_header *>(mapping);
+            buckets = static_cast<std::size_t>(header.buckets);
+            if (header.magic != shared_magic || header.version != shared_version || header.slot_size != sizeof(slot) ||
+                !std::has_single_bit(buckets) || bytes < sizeof(shared_header) + buckets * sizeof(bucket)) {
+                problem = "has another layout";
+            } else if (header.key_signature != signature.keys || header.evaluator_signature != signature.evaluator) {
+                problem = "was created with other hash keys or another evaluator";
+            }
+        }
+        ::close(fd);
+        if (!problem.empty()) {
+            spdlog::default_logger()->error("tt: shared table {} {}", path, problem);
+            if (mapping != MAP_FAILED) ::munmap(mapping, bytes);
+            return {};
+        }
+        return {wrap(mapping, bytes, buckets)};
+    }
+
+    // Whether `path` still names the segment open as `fd`, and not one
+    // another process has created since.
+    [[nodiscard]] static bool same_segment(const std::string &path, int fd) noexcept {
+        const int current = ::shm_open(path.c_str(), O_RDONLY, 0);
+        if (current < 0) return false;
+        struct stat ours{};
+        struct stat theirs{};
+        const bool same = ::fstat(fd, &ours) == 0 && ::fstat(current, &theirs) == 0 && ours.st_ino == theirs.st_ino &&
+                          ours.st_dev == theirs.st_dev;
+        ::close(current);
+        return same;
+    }
+
+    [[nodiscard]] static std::shared_ptr<table> wrap(void *mapping, std::size_t bytes, std::size_t buckets) {
+        std::shared_ptr<table> result(new table);
+        result->mapping_ = mapping;
+        result->mapping_bytes_ = bytes;
+        result->buckets_ = std::span(reinterpret_cast<bucket *>(static_cast<char *>(mapping) + sizeof(shared_header)), buckets);
+        result->mask_ = buckets - 1;
+        return result;
+    }
+#endif
+
+    [[nodiscard]] static std::size_t bucket_count(std::size_t megabytes) noexcept {
+        const std::size_t bytes = std::max<std::size_t>(megabytes, 1) * 1024 * 1024;
+        // Power of two so the bucket index is a mask.
+        return std::bit_floor(bytes / sizeof(bucket));
+    }
+
+    // value in bits 0-31, then flag, depth + 1, x and y; depth + 1 keeps a
+    // stored entry from ever packing to zero.
+    [[nodiscard]] static constexpr std::uint64_t pack(const entry &e) noexcept {
+        return std::uint64_t{static_cast<std::uint32_t>(e.value)} |
+               std::uint64_t{static_cast<std::uint8_t>(e.flag)} << 32 |
+               std::uint64_t{static_cast<std::uint8_t>(e.depth + 1)} << 40 |
+               std::uint64_t{static_cast<std::uint8_t>(e.best_move.x)} << 48 |
+               std::uint64_t{static_cast<std::uint8_t>(e.best_move.y)} << 56;
+    }
+
+    [[nodiscard]] static constexpr entry unpack(std::uint64_t data) noexcept {
+        return entry{static_cast<std::int32_t>(static_cast<std::uint32_t>(data)),
+                     static_cast<std::int8_t>(data >> 32),
+                     static_cast<int>(static_cast<std::uint8_t>(data >> 40)) - 1,
+                     point{static_cast<std::int8_t>(data >> 48), static_cast<std::int8_t>(data >> 56)}};
+    }
+
+    // Returns {key, data}; a torn slot yields a key that matches nothing.
+    [[nodiscard]] static std::pair<std::uint64_t, std::uint64_t> load(const slot &s) noexcept {
+        const auto check = std::atomic_ref(const_cast<std::uint64_t &>(s.check)).load(std::memory_order_relaxed);
+        const auto data = std::atomic_ref(const_cast<std::uint64_t &>(s.data)).load(std::memory_order_relaxed);
+        return {check ^ data, data};
+    }
+
+    static void store(slot &s, std::uint64_t key, std::uint64_t data) noexcept {
+        std::atomic_ref(s.check).store(key ^ data, std::memory_order_relaxed);
+        std::atomic_ref(s.data).store(data, std::memory_order_relaxed);
+    }
+
+    void unmap() noexcept {
+#ifndef _WIN32
+        if (mapping_) ::munmap(mapping_, mapping_bytes_);
+#endif
+        mapping_ = nullptr;
+    }
+
+    template <typename T>
+    static void write_value(std::ostream &out, T value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static void read_value(std::istream &in, T &value) {
+        in.read(reinterpret_cast<char *>(&value), sizeof(T));
+    }
+
+    memory::placement placement_ = memory::placement::interleave;
+    memory::large_buffer owned_;  // zero-filled, which is a table of empty slots
+    void *mapping_ = nullptr;  // shared-memory segment, header included
+    std::size_t mapping_bytes_ = 0;
+    std::span<bucket> buckets_;
+    std::size_t mask_{0};
+};
+
+// Direct-mapped cache of static evaluations, sized from its own budget.
+// An entry is one 64-bit word, the upper half of the key above the score,
+// so it is read and written with a single relaxed atomic access and never
+// seen half written; a colliding position simply overwrites the slot.
+class eval_cache {
+    static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free);
+
+public:
+    // 0 megabytes: no cache, find never hits and insert does nothing.
+    explicit eval_cache(std::size_t megabytes) {
+        if (megabytes == 0) return;
+        const std::size_t count = std::bit_floor(megabytes * 1024 * 1024 / sizeof(std::uint64_t));
+        storage_ = memory::large_buffer(count * sizeof(std::uint64_t));
+        entries_ = std::span(static_cast<std::uint64_t *>(storage_.data()), count);
+        mask_ = count - 1;
+    }
+
+    eval_cache(const eval_cache &) = delete;
+    eval_cache &operator=(const eval_cache &) = delete;
+
+    [[nodiscard]] bool enabled() const noexcept { return !entries_.empty(); }
+
+    [[nodiscard]] std::optional<int> find(std::uint64_t key) const noexcept {
+        if (entries_.empty()) return std::nullopt;
+        const auto word = std::atomic_ref(const_cast<std::uint64_t &>(entries_[key & mask_])).load(std::memory_order_relaxed);
+        if (word >> 32 != check_of(key)) return std::nullopt;
+        return static_cast<std::int32_t>(static_cast<std::uint32_t>(word));
+    }
+
+    void insert(std::uint64_t key, int score) noexcept {
+        if (entries_.empty()) return;
+        const auto word = std::uint64_t{check_of(key)} << 32 | static_cast<std::uint32_t>(score);
+        std::atomic_ref(entries_[key & mask_]).store(word, std::memory_order_relaxed);
+    }
+
+    // Needed whenever the evaluator changes.
+    void clear() noexcept {
+        for (auto &word : entries_) std::atomic_ref(word).store(0, std::memory_order_relaxed);
+    }
+
+private:
+    // Never zero, so an empty slot matches no key.
+    [[nodiscard]] static constexpr std::uint32_t check_of(std::uint64_t key) noexcept {
+        return static_cast<std::uint32_t>(key >> 32) | 1;
+    }
+
+    memory::large_buffer storage_;  // zero-filled: every slot empty
+    std::span<std::uint64_t> entries_;
+    std::size_t mask_{0};
+};
+
+}  // namespace tt
@@ -0,0 +1,295 @@
+import std;
+import ai;
+import chess_info;
+import game_record;
+import logging;
+import memory;
+import nnue;
+import point;
+import strings;
+import tool;
+import transposition_table;
+
+namespace {
+
+struct analyze_options {
+    std::filesystem::path input;
+    std::filesystem::path output = "analysis.tsv";
+    int depth = 8;
+    std::uint64_t node_limit = 0;
+    std::chrono::milliseconds move_time{0};
+    unsigned jobs = 0;  // 0: one per hardware thread
+    std::size_t tt_megabytes = 16;  // per job
+    int lines = 1;                  // ranked alternatives per position
+    std::filesystem::path snapshot; // warm-start TT, shared by all jobs
+    std::string shared_memory;      // TT in this POSIX shared-memory segment, shared with other processes
+    memory::placement placement = memory::placement::interleave;  // TT pages on a NUMA host
+};
+
+std::optional<analyze_options> parse_options(const std::vector<std::string_view> &args) {
+    analyze_options options;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const auto flag = args[i];
+        if (!flag.starts_with("--")) {
+            options.input = std::filesystem::path{flag};
+            continue;
+        }
+        if (i + 1 >= args.size()) {
+            return std::nullopt;
+        }
+        const auto value = args[++i];
+        long long number = 0;
+        const bool numeric = std::from_chars(value.data(), value.data() + value.size(), number).ec == std::errc{} && number >= 0;
+        if (flag == "--out") options.output = std::filesystem::path{value};
+        else if (flag == "--depth" && numeric) options.depth = static_cast<int>(number);
+        else if (flag == "--nodes" && numeric) options.node_limit = static_cast<std::uint64_t>(number);
+        else if (flag == "--time" && numeric) options.move_time = std::chrono::milliseconds{number};
+        else if (flag == "--jobs" && numeric) options.jobs = static_cast<unsigned>(number);
+        else if (flag == "--tt" && numeric) options.tt_megabytes = static_cast<std::size_t>(number);
+        else if (flag == "--multipv" && numeric && number > 0) options.lines = static_cast<int>(number);
+        else if (flag == "--tt-snapshot") options.snapshot = std::filesystem::path{value};
+        else if (flag == "--tt-shm") options.shared_memory = std::string(value);
+        else if (flag == "--tt-numa" && (value == "interleave" || value == "partition")) {
+            options.placement = value == "partition" ? memory::placement::partition : memory::placement::interleave;
+        }
+        else if (flag != "--nnue") return std::nullopt;
+    }
+    if (options.input.empty()) {
+        return std::nullopt;
+    }
+    return options;
+}
+
+// Position `ply` of game `game` is the board before that move was played.
+[[nodiscard]] constexpr std::uint64_t position_key(std::uint64_t game, std::uint64_t ply) noexcept {
+    return game << 16 | ply;
+}
+
+// Collects the positions already in `path` and cuts off a partial last line
+// left by an interrupted run, so appending continues cleanly.
+std::unordered_set<std::uint64_t> load_finished(const std::filesystem::path &path) {
+    std::unordered_set<std::uint64_t> finished;
+    std::error_code error;
+    if (!std::filesystem::exists(path, error)) {
+        return finished;
+    }
+    std::ifstream in(path, std::ios::binary);
+    std::string line;
+    std::uintmax_t complete_bytes = 0;
+    while (std::getline(in, line)) {
+        if (in.eof()) {
+            break;  // no trailing newline: interrupted mid-line
+        }
+        complete_bytes += line.size() + 1;
+        std::uint64_t game = 0;
+        std::uint64_t ply = 0;
+        const auto tab = line.find('\t');
+        if (line.starts_with('#') || tab == std::string::npos ||
+            std::from_chars(line.data(), line.data() + tab, game).ec != std::errc{} ||
+            std::from_chars(line.data() + tab + 1, line.data() + line.size(), ply).ec != std::errc{}) {
+            continue;
+        }
+        finished.insert(position_key(game, ply));
+    }
+    in.close();
+    if (complete_bytes != std::filesystem::file_size(path, error)) {
+        std::filesystem::resize_file(path, complete_bytes, error);
+    }
+    return finished;
+}
+
+struct position_job {
+    record::game_view game;
+    int index = 0;
+    int ply = 0;
+};
+
+// Returns nullopt if a move is off the board or onto a taken cell.
+[[nodiscard]] std::optional<chess_info> replay(const record::game_view &game, int plies) {
+    chess_info state;
+    for (int i = 0; i < plies; ++i) {
+        const point move = game.move(i);
+        if (!move.is_on_board<board_rows>() || state.pieces[move.x][move.y] != 0) {
+            return std::nullopt;
+        }
+        state.pieces[move.x][move.y] = state.turn == black_turn ? black_piece : white_piece;
+        state.current_point = move;
+        state.turn ^= 1;
+        state.round += 1;
+    }
+    return state;
+}
+
+// Hands out positions in file order. Only the cursor is shared, so memory
+// stays flat however large the archive is.
+class position_cursor {
+public:
+    position_cursor(const record::reader &games, const std::unordered_set<std::uint64_t> &finished)
+        : current_(games.begin()), end_(games.end()), finished_(finished) {}
+
+    std::optional<position_job> next() {
+        std::lock_guard lock(mutex_);
+        while (current_ != end_) {
+            if (ply_ == 1 && !replay(*current_, current_->move_count())) {
+                std::cout << std::format("Skipping game {}: invalid move\n", index_);
+                ply_ = current_->move_count();
+            }
+            if (ply_ >= current_->move_count()) {
+                ++current_;
+                ++index_;
+                ply_ = 1;
+                continue;
+            }
+            const int ply = ply_++;
+            if (finished_.contains(position_key(static_cast<std::uint64_t>(index_), static_cast<std::uint64_t>(ply)))) {
+                ++skipped_;
+                continue;
+            }
+            return position_job{*current_, index_, ply};
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] std::size_t skipped() const {
+        std::lock_guard lock(mutex_);
+        return skipped_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    record::reader::iterator current_;
+    record::reader::iterator end_;
+    const std::unordered_set<std::uint64_t> &finished_;
+    int index_ = 0;
+    int ply_ = 1;  // the empty board is not worth a search
+    std::size_t skipped_ = 0;
+};
+
+[[nodiscard]] std::string format_moves(const std::vector<point> &moves) {
+    std::string text;
+    for (const point move : moves) {
+        text += text.empty() ? "" : " ";
+        text += tool::format_move(move);
+    }
+    return text;
+}
+
+// Tab separated: game, ply, side, played move, best move, score (side to
+// move), depth, nodes, milliseconds, principal variation and, with
+// --multipv, the ranked lines as "move:score:pv" separated by " | ".
+[[nodiscard]] std::string format_result(const position_job &job, const chess_info &state, const ai::search_info &info,
+                                        const std::vector<ai::pv_line> &lines) {
+    std::string result = std::format("{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{:.1f}\t{}", job.index, job.ply,
+                                     state.turn == black_turn ? "black" : "white", tool::format_move(job.game.move(job.ply)),
+                                     info.best_move.is_valid() ? tool::format_move(info.best_move) : "none", info.score,
+                                     info.depth, info.nodes, info.seconds * 1000.0, format_moves(info.pv));
+    for (std::size_t i = 0; i < lines.size(); ++i) {
+        result += std::format("{}{}:{}:{}", i == 0 ? "\t" : " | ", tool::format_move(lines[i].move), lines[i].score,
+                              format_moves(lines[i].pv));
+    }
+    return result + '\n';
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    const std::vector<std::string_view> args(argv + 1, argv + argc);
+    const auto options = parse_options(args);
+    if (!options) {
+        std::cout << "usage: gomoku_analyze <games.gmr> [--out analysis.tsv] [--depth N] [--nodes N] [--time ms]\n"
+                     "                      [--jobs N] [--tt MB] [--multipv K] [--tt-snapshot file]\n"
+                     "                      [--tt-shm name] [--tt-numa interleave|partition] [--nnue file]\n";
+        return 1;
+    }
+    for (std::size_t i = 0; i + 1 < args.size(); ++i) {
+        if (args[i] == "--nnue") {
+            ai::set_default_network(nnue::network::load(std::filesystem::path{args[i + 1]}));
+        }
+    }
+
+    const auto games = record::reader::open(options->input);
+    if (!games) {
+        logging::shutdown();
+        return 1;
+    }
+    const auto finished = load_finished(options->output);
+    std::error_code error;
+    const bool fresh = !std::filesystem::exists(options->output, error) || std::filesystem::file_size(options->output, error) == 0;
+    std::ofstream out(options->output, std::ios::binary | std::ios::app);
+    if (fresh) {
+        out << "# game\tply\tside\tplayed\tbest\tscore\tdepth\tnodes\tms\tpv\n";
+    }
+
+    position_cursor cursor(*games, finished);
+    std::mutex out_mutex;
+    std::atomic<std::size_t> analyzed{0};
+    const auto start = std::chrono::steady_clock::now();
+
+    // Parallel over positions: every job owns a single-threaded engine and
+    // its own TT, so memory is jobs * tt megabytes. With a snapshot the jobs
+    // share one table of that size instead, loaded before and saved after.
+    // With --tt-shm that table lives in shared memory, and every process
+    // started with the same name searches into it.
+    const unsigned jobs = options->jobs != 0 ? options->jobs : std::max(1u, std::thread::hardware_concurrency());
+    std::shared_ptr<tt::table> shared_table;
+    const auto signature = ai::snapshot_signature(ai::default_network().get());
+    if (!options->shared_memory.empty()) {
+        shared_table = tt::table::open_shared(options->shared_memory, options->tt_megabytes * jobs, signature);
+        if (!shared_table) {
+            std::cout << "Cannot use shared table " << options->shared_memory << ", see the log.\n";
+            logging::shutdown();
+            return 1;
+        }
+    }
+    if (!options->snapshot.empty()) {
+        if (!shared_table) shared_table = std::make_shared<tt::table>(options->tt_megabytes * jobs, options->placement);
+        if (std::filesystem::exists(options->snapshot, error)) {
+            if (const auto loaded = shared_table->load(options->snapshot, signature)) {
+                std::cout << *loaded << " TT entries loaded from " << options->snapshot.string() << '\n';
+            }
+        }
+    }
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned j = 0; j < jobs; ++j) {
+            workers.emplace_back([&] {
+                ai::engine_options config{.depth = options->depth, .tt_megabytes = options->tt_megabytes, .threads = 1,
+                                          .move_time = options->move_time, .node_limit = options->node_limit};
+                config.tt_placement = options->placement;
+                config.table = shared_table;
+                ai::engine engine(config);
+                while (const auto job = cursor.next()) {
+                    const auto replayed = replay(job->game, job->ply);
+                    if (!replayed) {
+                        continue;
+                    }
+                    const chess_info &state = *replayed;
+                    engine.set_rules(job->game.rules());
+                    std::vector<ai::pv_line> lines;
+                    if (options->lines > 1) {
+                        lines = engine.analyze(state, options->lines);
+                    } else {
+                        static_cast<void>(engine.get_best_point(state));
+                    }
+                    const auto line = format_result(*job, state, engine.last_search(), lines);
+
+                    std::lock_guard lock(out_mutex);
+                    out << line;
+                    out.flush();
+                    if (++analyzed % 1000 == 0) {
+                        std::cout << analyzed << " positions analyzed\n";
+                    }
+                }
+            });
+        }
+    }
+
+    if (shared_table && !options->snapshot.empty()) {
+        shared_table->save(options->snapshot, signature);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << std::format("{} positions analyzed, {} already done, {:.1f} s, results in {}\n", analyzed.load(),
+                             cursor.skipped(), seconds, options->output.string());
+    logging::shutdown();
+    return 0;
+}
@@ -0,0 +1,128 @@
+import std;
+import logging;
+import point;
+import rule;
+import strings;
+
+// Checks rule::basic_forbidden_map against renju_rules::is_forbidden, and
+// rule::basic_run_lengths against rule::is_win and rule::is_long_chain, on
+// random place/remove sequences, on every supported board size. Prints a
+// summary per size; exits with 1 on any mismatch.
+
+namespace {
+
+struct tally {
+    long checks = 0;
+    long forbidden = 0;
+    long mismatches = 0;
+    long run_checks = 0;
+    long run_mismatches = 0;
+};
+
+// Compares the run table with the board walks, for both colours, on every
+// cell whose runs a change at `changed` can reach.
+template <int Size>
+void check_runs(int (&board)[Size + 1][Size + 1], const rule::basic_run_lengths<Size> &runs, point changed, tally &result) {
+    const auto compare = [&](point p, int color) {
+        ++result.run_checks;
+        result.run_mismatches += runs.is_win(p, color) != rule::is_win(board, p) ||
+                                 runs.is_long_chain(p, color) != rule::is_long_chain(board, p, color);
+    };
+    const auto check_cell = [&](point p) {
+        if (board[p.x][p.y] != 0) {
+            compare(p, board[p.x][p.y]);
+            return;
+        }
+        for (const int color : {black_piece, white_piece}) {
+            board[p.x][p.y] = color;
+            compare(p, color);
+            board[p.x][p.y] = 0;
+        }
+    };
+    check_cell(changed);
+    for (const point axis : {point{1, 0}, point{0, 1}, point{1, 1}, point{1, -1}}) {
+        for (int k = -6; k <= 6; ++k) {
+            const point p{changed.x + k * axis.x, changed.y + k * axis.y};
+            if (k != 0 && p.is_on_board<Size>()) check_cell(p);
+        }
+    }
+}
+
+template <int Size>
+tally check_size(std::uint32_t seed, int games) {
+    std::mt19937 rng(seed);
+    tally result;
+    for (int game = 0; game < games; ++game) {
+        int board[Size + 1][Size + 1]{};
+        rule::basic_run_lengths<Size> runs{board};
+        rule::basic_forbidden_map<Size> map;
+        map.reset(board, runs);
+        std::vector<std::pair<point, int>> placed;
+        const int moves = 20 + static_cast<int>(rng() % 120);
+        for (int k = 0; k < moves; ++k) {
+            if (!placed.empty() && rng() % 4 == 0) {
+                const auto [p, color] = placed.back();
+                placed.pop_back();
+                board[p.x][p.y] = 0;
+                runs.remove(board, p, color);
+                map.update(board, runs, p);
+                check_runs<Size>(board, runs, p, result);
+                continue;
+            }
+            // Crowded near the centre, so forbidden shapes come up often;
+            // some games reach the edges too.
+            const int spread = game % 4 == 0 ? Size : 9;
+            const int low = (Size - spread) / 2 + 1;
+            const point p{low + static_cast<int>(rng() % spread), low + static_cast<int>(rng() % spread)};
+            if (board[p.x][p.y] != 0) continue;
+            const int color = rng() % 3 != 0 ? black_piece : white_piece;
+            board[p.x][p.y] = color;
+            runs.place(board, p, color);
+            map.update(board, runs, p);
+            check_runs<Size>(board, runs, p, result);
+            placed.emplace_back(p, color);
+        }
+        for (int x = 1; x <= Size; ++x) {
+            for (int y = 1; y <= Size; ++y) {
+                const point p{x, y};
+                bool expected = false;
+                if (board[x][y] == 0) {
+                    board[x][y] = black_piece;
+                    expected = rule::renju_rules::is_forbidden<black_piece>(board, p);
+                    board[x][y] = 0;
+                }
+                ++result.checks;
+                result.forbidden += expected;
+                result.mismatches += map.contains(p) != expected;
+            }
+        }
+    }
+    return result;
+}
+
+template <int Size>
+bool report(std::uint32_t seed, int games) {
+    const auto [checks, forbidden, mismatches, run_checks, run_mismatches] = check_size<Size>(seed, games);
+    std::cout << std::format("{}x{}: {} checks, {} forbidden, {} mismatches; {} run checks, {} mismatches\n", Size, Size,
+                             checks, forbidden, mismatches, run_checks, run_mismatches);
+    return mismatches == 0 && run_mismatches == 0;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    int games = 200;
+    if (argc > 1) {
+        const std::string_view text = argv[1];
+        if (std::from_chars(text.data(), text.data() + text.size(), games).ec != std::errc{} || games <= 0) {
+            std::cout << "usage: gomoku_forbidden_check [games per board size]\n";
+            return 1;
+        }
+    }
+    // The rule:: walks log every shape they find; keep that out of rule.log.
+    const logging::search_scope quiet;
+    bool ok = report<15>(11, games);
+    ok = report<19>(12, games) && ok;
+    ok = report<20>(13, games) && ok;
+    return ok ? 0 : 1;
+}
@@ -7,29 +7,65 @@ set_languages("c++latest")
 set_policy("build.c++.modules", true)
 set_policy("build.c++.modules.std", true)
 
+option("avx2")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build the NNUE kernels with AVX2")
+    add_cxxflags("-mavx2", "-mfma")
+option_end()
+
+option("trace")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Compile in Chrome trace instrumentation")
+    add_defines("GOMOKU_TRACE=1")
+option_end()
+
 add_requires("spdlog")
 add_requires("stdexec")
 
+local function use_toolchain(target)
+    import("lib.detect.find_tool")
+    import("core.base.semver")
+
+    local clang = find_tool("clang", {version = true})
+    if clang and clang.version and semver.compare(clang.version, "20.0") >= 0 then
+        target:set("toolchains", "llvm")
+        target:add("cxxflags", "-stdlib=libc++", "-fconstexpr-steps=1000000000")
+        target:set("runtimes", "c++_shared")
+    elseif target:has_tool("cxx", "cl") then
+        target:add("cxxflags", "/utf-8", "/EHsc", "/constexpr:steps1000000000")
+    elseif target:has_tool("cxx", "clang", "clang++") then
+        target:add("cxxflags", "-stdlib=libc++", "-fconstexpr-steps=1000000000")
+        target:set("runtimes", "c++_shared")
+    else
+        target:add("cxxflags", "-fconstexpr-ops-limit=1000000000")
+    end
+end
+
 target("gomoku")
     set_kind("binary")
     set_targetdir("bin")
     -- add_includedirs("include")
     add_files("main.cpp", "src/*.cpp")
     add_packages("spdlog", "stdexec")
+    add_options("avx2", "trace")
+    on_load(use_toolchain)
 
-    on_load(function (target)
-        import("lib.detect.find_tool")
-        import("core.base.semver")
-
-        local clang = find_tool("clang", {version = true})
-        if clang and clang.version and semver.compare(clang.version, "20.0") >= 0 then
-            target:set("toolchains", "llvm")
-            target:add("cxxflags", "-stdlib=libc++")
-            target:set("runtimes", "c++_shared")
-        elseif target:has_tool("cxx", "cl") then
-            target:add("cxxflags", "/utf-8", "/EHsc")
-        elseif target:has_tool("cxx", "clang", "clang++") then
-            target:add("cxxflags", "-stdlib=libc++")
-            target:set("runtimes", "c++_shared")
-        end
-    end)
+target("gomoku_analyze")
+    set_kind("binary")
+    set_targetdir("bin")
+    add_files("tools/analyze.cpp", "src/*.cpp")
+    add_packages("spdlog", "stdexec")
+    add_options("avx2", "trace")
+    on_load(use_toolchain)
+
+target("gomoku_forbidden_check")
+    set_kind("binary")
+    set_targetdir("bin")
+    set_default(false)
+    add_files("tools/forbidden_check.cpp", "src/*.cpp")
+    add_packages("spdlog", "stdexec")
+    add_options("avx2", "trace")
+    on_load(use_toolchain)
+    add_tests("default")